@@ -6,28 +6,33 @@
 #include "uvw/stream.h"
 
 #include <algorithm>
+#include <cassert>
 namespace
 {
-void freeBuf(buffer_t* buf)
+buffer_t inputBuf(const char* data, size_t len)
 {
-    free(buf->data);
-    free(buf);
+    return buffer_t { 0, len, len, const_cast<char*>(data) };
 }
 } // namespace
 Buffer::Buffer()
-    : buf { newBuf(), freeBuf }
+    : buf { 0, 0, 0, nullptr }
 {
 }
 
+Buffer::~Buffer()
+{
+    BufferPool::recycle(buf.data, buf.capacity);
+}
+
 size_t* Buffer::getLengthPtr()
 {
-    return &buf->len;
+    return &buf.len;
 }
 
 buffer_t* Buffer::newBuf()
 {
     auto bufPtr = reinterpret_cast<buffer_t*>(malloc(sizeof(buffer_t)));
-    balloc(bufPtr, Buffer::BUF_DEFAULT_CAPACITY);
+    bufPtr->data = BufferPool::acquire(Buffer::BUF_DEFAULT_CAPACITY);
     bufPtr->capacity = Buffer::BUF_DEFAULT_CAPACITY;
     bufPtr->len = 0;
     bufPtr->idx = 0;
@@ -36,64 +41,108 @@ buffer_t* Buffer::newBuf()
 
 char Buffer::operator[](int idx)
 {
-    return buf->data[idx % (buf->capacity)];
+    // the data is contiguous from buf.idx, and a buffer without data has no block.
+    assert(idx >= 0 && static_cast<size_t>(idx) < buf.len);
+    return buf.data[buf.idx + idx];
 }
 
 char** Buffer::getBufPtr()
 {
-    return &buf->data;
+    compact();
+    return &buf.data;
 }
 
 char* Buffer::back()
 {
-    if (buf)
-        return buf->data + buf->len;
-    return nullptr;
+    return buf.data + buf.idx + buf.len;
 }
 
 char* Buffer::begin()
 {
-    return buf->data;
+    return buf.data + buf.idx;
 }
 
 void Buffer::clear()
 {
-    buf->len = 0;
+    buf.idx = 0;
+    buf.len = 0;
+    BufferPool::recycle(buf.data, buf.capacity);
+    buf.data = nullptr;
+    buf.capacity = 0;
 }
 
 void Buffer::drop(size_t size)
 {
-    if (buf->len < size)
+    if (buf.len < size)
+        return;
+    if (buf.len == size) {
+        clear();
+        return;
+    }
+    buf.idx += size;
+    buf.len -= size;
+}
+
+buffer_t* Buffer::output()
+{
+    reserve();
+    buf.idx = 0;
+    return &buf;
+}
+
+void Buffer::compact()
+{
+    if (buf.idx == 0)
+        return;
+    memmove(buf.data, buf.data + buf.idx, buf.len);
+    buf.idx = 0;
+}
+
+void Buffer::reserve()
+{
+    if (buf.data)
         return;
-    memmove(buf->data, buf->data + size, buf->len - size);
-    buf->len -= size;
+    buf.data = BufferPool::acquire(BUF_DEFAULT_CAPACITY);
+    buf.capacity = BUF_DEFAULT_CAPACITY;
 }
 
 void Buffer::bufRealloc(size_t size)
 {
-    if (buf->capacity == size)
+    if (buf.capacity == size)
         return;
-    buf->data = reinterpret_cast<char*>(realloc(buf->data, size * sizeof(char)));
-    buf->capacity = size;
-    buf->len = buf->capacity < buf->len ? buf->capacity : buf->len;
+    compact();
+    buf.data = reinterpret_cast<char*>(realloc(buf.data, size * sizeof(char)));
+    buf.capacity = size;
+    buf.len = buf.capacity < buf.len ? buf.capacity : buf.len;
 }
 
 std::unique_ptr<char[]> Buffer::duplicateDataToArray()
 {
-    std::unique_ptr<char[]> data { new char[buf->len]() };
-    memcpy(data.get(), buf->data, buf->len);
+    std::unique_ptr<char[]> data { new char[buf.len]() };
+    memcpy(data.get(), begin(), buf.len);
     return data;
 }
 
+BufferPool::Storage Buffer::release()
+{
+    compact();
+    BufferPool::Storage storage { buf.data, BufferPool::StorageDeleter { buf.capacity } };
+    buf.data = nullptr;
+    buf.capacity = 0;
+    buf.len = 0;
+    return storage;
+}
+
 void Buffer::copy(const uvw::DataEvent& event)
 {
     if (event.length == 0)
         return;
-    if (event.length + buf->len <= buf->capacity) {
+    reserve();
+    if (event.length + buf.len <= buf.capacity) {
         this->copy(event.data.get(), event.data.get() + event.length);
         return;
     } else {
-        bufRealloc((buf->len + event.length) * 2);
+        bufRealloc((buf.len + event.length) * 2);
         this->copy(event.data.get(), event.data.get() + event.length);
         return;
     }
@@ -103,11 +152,12 @@ void Buffer::copy(const uvw::UDPDataEvent& event)
 {
     if (event.length == 0)
         return;
-    if (event.length + buf->len <= buf->capacity) {
+    reserve();
+    if (event.length + buf.len <= buf.capacity) {
         this->copy(event.data.get(), event.data.get() + event.length);
         return;
     } else {
-        bufRealloc((buf->len + event.length) * 2);
+        bufRealloc((buf.len + event.length) * 2);
         this->copy(event.data.get(), event.data.get() + event.length);
         return;
     }
@@ -117,8 +167,10 @@ void Buffer::copyFromBegin(const uvw::DataEvent& event, int length)
 {
     auto start = event.data.get();
     auto size = length == -1 ? event.length : length;
-    buf->len = 0;
-    if (size <= buf->capacity) {
+    reserve();
+    buf.idx = 0;
+    buf.len = 0;
+    if (size <= buf.capacity) {
         this->copy(start, start + size);
         return;
     } else {
@@ -130,8 +182,10 @@ void Buffer::copyFromBegin(const uvw::DataEvent& event, int length)
 
 void Buffer::copyFromBegin(char* start, size_t size)
 {
-    buf->len = 0;
-    if (size <= buf->capacity) {
+    reserve();
+    buf.idx = 0;
+    buf.len = 0;
+    if (size <= buf.capacity) {
         this->copy(start, start + size);
         return;
     } else {
@@ -143,58 +197,102 @@ void Buffer::copyFromBegin(char* start, size_t size)
 
 void Buffer::copy(const Buffer& that)
 {
-    memcpy(buf->data, that.buf->data, that.buf->len);
-    buf->len = that.buf->len;
+    reserve();
+    buf.idx = 0;
+    memcpy(buf.data, that.buf.data + that.buf.idx, that.buf.len);
+    buf.len = that.buf.len;
 }
 
 void Buffer::setLength(int l)
 {
-    buf->len = l;
+    buf.len = l;
 }
 
 size_t Buffer::length()
 {
-    return buf->len;
+    return buf.len;
+}
+
+size_t Buffer::capacity()
+{
+    return buf.capacity;
+}
+
+int Buffer::ssEncrypt(CipherEnv& cipherEnv, ConnectionContext& connectionContext, const char* data, size_t len)
+{
+    auto in = inputBuf(data, len);
+    int err = cipherEnv.crypto->encrypt(&in, output(), &connectionContext.e_ctx, BUF_DEFAULT_CAPACITY);
+    return err;
+}
+
+int Buffer::ssDecrypt(CipherEnv& cipherEnv, ConnectionContext& connectionContext, const char* data, size_t len)
+{
+    auto in = inputBuf(data, len);
+    int err = cipherEnv.crypto->decrypt(&in, output(), &connectionContext.d_ctx, BUF_DEFAULT_CAPACITY);
+    return err;
 }
 
-int Buffer::ssEncrypt(CipherEnv& cipherEnv, ConnectionContext& connectionContext)
+int Buffer::ssEncryptVec(CipherEnv& cipherEnv, ConnectionContext& connectionContext, char* data, size_t len,
+    uv_buf_t* bufs, unsigned int& nbufs)
 {
-    int err = cipherEnv.crypto->encrypt(buf.get(), connectionContext.e_ctx.get(), BUF_DEFAULT_CAPACITY);
+    auto in = inputBuf(data, len);
+    buffer_t vec[MAX_VEC_BUFS];
+    size_t nvec = MAX_VEC_BUFS;
+    int err = cipherEnv.crypto->encrypt_vec(&in, output(), vec, &nvec, &connectionContext.e_ctx, BUF_DEFAULT_CAPACITY);
+    if (err)
+        return err;
+    for (size_t i = 0; i < nvec; ++i)
+        bufs[i] = uv_buf_init(vec[i].data, static_cast<unsigned int>(vec[i].len));
+    nbufs = static_cast<unsigned int>(nvec);
     return err;
 }
 
-int Buffer::ssDecrypt(CipherEnv& cipherEnv, ConnectionContext& connectionContext)
+int Buffer::ssDecryptVec(CipherEnv& cipherEnv, ConnectionContext& connectionContext, char* data, size_t len,
+    uv_buf_t* bufs, unsigned int& nbufs)
 {
-    int err = cipherEnv.crypto->decrypt(buf.get(), connectionContext.d_ctx.get(), BUF_DEFAULT_CAPACITY);
+    auto in = inputBuf(data, len);
+    buffer_t vec[MAX_VEC_BUFS];
+    size_t nvec = MAX_VEC_BUFS;
+    int err = cipherEnv.crypto->decrypt_vec(&in, &buf, vec, &nvec, &connectionContext.d_ctx, BUF_DEFAULT_CAPACITY);
+    // the block is only taken for a frame that started in an earlier read.
+    if (buf.len == 0)
+        clear();
+    if (err)
+        return err;
+    for (size_t i = 0; i < nvec; ++i)
+        bufs[i] = uv_buf_init(vec[i].data, static_cast<unsigned int>(vec[i].len));
+    nbufs = static_cast<unsigned int>(nvec);
     return err;
 }
 
 size_t* Buffer::getCapacityPtr()
 {
-    return &buf->capacity;
+    return &buf.capacity;
 }
 
 void Buffer::copy(char* start, char* end)
 {
+    if (buf.idx + buf.len + (end - start) > buf.capacity)
+        compact();
     memcpy(back(), start, end - start);
-    buf->len += end - start;
+    buf.len += end - start;
 }
 
-int Buffer::ssEncryptAll(CipherEnv& cipherEnv)
+int Buffer::ssEncryptAll(CipherEnv& cipherEnv, const char* data, size_t len)
 {
-    int err = cipherEnv.crypto->encrypt_all(buf.get(), cipherEnv.crypto->cipher, UDPRelay::DEFAULT_PACKET_SIZE * 2);
+    auto in = inputBuf(data, len);
+    int err = cipherEnv.crypto->encrypt_all(&in, output(), cipherEnv.crypto->cipher, UDPRelay::DEFAULT_PACKET_SIZE * 2);
     return err;
 }
 
-int Buffer::ssDecryptALl(CipherEnv& cipherEnv)
+int Buffer::ssDecryptALl(CipherEnv& cipherEnv, const char* data, size_t len)
 {
-    int err = cipherEnv.crypto->decrypt_all(buf.get(), cipherEnv.crypto->cipher, UDPRelay::DEFAULT_PACKET_SIZE * 2);
+    auto in = inputBuf(data, len);
+    int err = cipherEnv.crypto->decrypt_all(&in, output(), cipherEnv.crypto->cipher, UDPRelay::DEFAULT_PACKET_SIZE * 2);
     return err;
 }
 
 char* Buffer::end()
 {
-    if (buf)
-        return buf->data + buf->capacity;
-    return nullptr;
+    return buf.data + buf.capacity;
 }
@@ -1,5 +1,7 @@
 #ifndef SSRUVBUFFER_H
 #define SSRUVBUFFER_H
+#include "BufferPool.hpp"
+
 #include <memory>
 extern "C"
 {
@@ -14,6 +16,10 @@ namespace uvw
 struct DataEvent;
 struct UDPDataEvent;
 }
+// the storage block is taken from BufferPool when data arrives and given back by clear(), release()
+// and a drop() of everything, an idle Buffer holds no memory.
+// the content starts at buf.idx: drop() only moves that offset, the bytes move to the front of the
+// block once an append does not fit behind them any more.
 class Buffer
 {
     // +----+-----+-------+------+----------+----------+
@@ -23,6 +29,9 @@ class Buffer
     // +----+-----+-------+------+----------+----------+
 public:
     Buffer();
+    ~Buffer();
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
     size_t* getLengthPtr();
     static buffer_t* newBuf();
     char operator[](int idx);
@@ -30,10 +39,12 @@ public:
     char* back();
     char* begin();
     char* end();
-    void clear();
+    void clear(); // also gives the storage block back
     void drop(size_t size);
     void bufRealloc(size_t size);
     std::unique_ptr<char[]> duplicateDataToArray();
+    // hand the storage with its length() bytes over (e.g. to a write request), the buffer is empty afterwards.
+    BufferPool::Storage release();
     void copy(const uvw::DataEvent& event);
     void copy(const uvw::UDPDataEvent& event);
     void copyFromBegin(const uvw::DataEvent& event, int length = -1);
@@ -41,17 +52,32 @@ public:
     void copy(const Buffer& that);
     void setLength(int l);
     size_t length();
-    int ssEncrypt(CipherEnv& cipherEnv, ConnectionContext& connectionContext);
-    int ssDecrypt(CipherEnv& cipherEnv, ConnectionContext& connectionContext);
-    int ssEncryptAll(CipherEnv& cipherEnv);
-    int ssDecryptALl(CipherEnv& cipherEnv);
+    size_t capacity(); // 0 while no storage block is held
+    // the ss* family replaces the content of this buffer with the result of [data, data + len).
+    int ssEncrypt(CipherEnv& cipherEnv, ConnectionContext& connectionContext, const char* data, size_t len);
+    int ssDecrypt(CipherEnv& cipherEnv, ConnectionContext& connectionContext, const char* data, size_t len);
+    int ssEncryptAll(CipherEnv& cipherEnv, const char* data, size_t len);
+    int ssDecryptALl(CipherEnv& cipherEnv, const char* data, size_t len);
+    // encrypts [data, data + len) in place, this buffer gets the salt, lengths and tags around it.
+    // bufs receives up to MAX_VEC_BUFS pieces to write in order. only for ciphers with encrypt_vec.
+    int ssEncryptVec(CipherEnv& cipherEnv, ConnectionContext& connectionContext, char* data, size_t len,
+        uv_buf_t* bufs, unsigned int& nbufs);
+    // decrypts the complete frames of [data, data + len) in place, this buffer gets a frame that started in an
+    // earlier read. bufs receives up to MAX_VEC_BUFS pieces to write in order. only for ciphers with decrypt_vec.
+    int ssDecryptVec(CipherEnv& cipherEnv, ConnectionContext& connectionContext, char* data, size_t len,
+        uv_buf_t* bufs, unsigned int& nbufs);
     size_t* getCapacityPtr();
 
 public:
     static constexpr size_t BUF_DEFAULT_CAPACITY = (16 * 1024 - 1);
+    // enough for 8 AEAD chunks, more than one read slab holds.
+    static constexpr size_t MAX_VEC_BUFS = 2 * 8 + 1;
 
 private:
-    std::unique_ptr<buffer_t, void (*)(buffer_t*)> buf;
+    void reserve(); // takes a storage block if none is held
+    void compact(); // moves the content to the start of the block
+    buffer_t* output(); // for the ss* results, written from the start of the block
+    buffer_t buf; // inline, only the storage block is allocated (from the pool)
     void copy(char* start, char* end);
 };
 #endif // SSRUVBUFFER_H
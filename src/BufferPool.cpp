@@ -0,0 +1,202 @@
+#include "BufferPool.hpp"
+
+#include "Buffer.hpp"
+
+#include <cstddef>
+#include <cstdlib>
+#include <vector>
+namespace
+{
+// one list per size class, Buffer blocks and the AEAD chunks that hold a partial frame.
+struct FreeList
+{
+    std::vector<char*> blocks;
+    std::vector<char*> chunks;
+    ~FreeList();
+};
+// trivially destructible, still readable while other thread_local objects are destroyed.
+thread_local bool freeListAlive = false;
+thread_local FreeList freeList;
+
+FreeList::~FreeList()
+{
+    freeListAlive = false;
+    for (auto block : blocks) {
+        free(block);
+    }
+    for (auto chunk : chunks) {
+        free(chunk);
+    }
+}
+
+FreeList* currentFreeList()
+{
+    static thread_local bool initialized = false;
+    if (!initialized) {
+        initialized = true;
+        freeListAlive = true;
+        freeList.blocks.reserve(BufferPool::MAX_POOLED_BLOCKS);
+        freeList.chunks.reserve(BufferPool::MAX_POOLED_BLOCKS);
+    }
+    return freeListAlive ? &freeList : nullptr;
+}
+
+// the list for blocks of capacity, other sizes are not pooled.
+std::vector<char*>* sizeClass(size_t capacity)
+{
+    if (capacity != Buffer::BUF_DEFAULT_CAPACITY && capacity != BPOOL_CHUNK_CAPACITY)
+        return nullptr;
+    auto list = currentFreeList();
+    if (list == nullptr)
+        return nullptr;
+    return capacity == Buffer::BUF_DEFAULT_CAPACITY ? &list->blocks : &list->chunks;
+}
+} // namespace
+
+void BufferPool::StorageDeleter::operator()(char* data) const
+{
+    BufferPool::recycle(data, capacity);
+}
+
+char* BufferPool::acquire(size_t capacity)
+{
+    auto list = sizeClass(capacity);
+    if (list && !list->empty()) {
+        auto block = list->back();
+        list->pop_back();
+        return block;
+    }
+    return reinterpret_cast<char*>(malloc(capacity));
+}
+
+void BufferPool::recycle(char* data, size_t capacity)
+{
+    if (data == nullptr)
+        return;
+    auto list = sizeClass(capacity);
+    if (list && list->size() < MAX_POOLED_BLOCKS) {
+        list->push_back(data);
+        return;
+    }
+    free(data);
+}
+
+char* bpool_acquire(size_t capacity)
+{
+    return BufferPool::acquire(capacity);
+}
+
+void bpool_recycle(char* data, size_t capacity)
+{
+    BufferPool::recycle(data, capacity);
+}
+
+size_t BufferPool::pooledCount()
+{
+    auto list = sizeClass(Buffer::BUF_DEFAULT_CAPACITY);
+    return list ? list->size() : 0;
+}
+
+size_t BufferPool::pooledChunkCount()
+{
+    auto list = sizeClass(BPOOL_CHUNK_CAPACITY);
+    return list ? list->size() : 0;
+}
+
+namespace
+{
+// every slab starts with its usable size, deallocate only gets the data pointer.
+constexpr size_t SLAB_HEADER = alignof(std::max_align_t);
+constexpr size_t MAX_CACHED_BATCH_SLABS = 4;
+
+size_t& slabLength(char* slab)
+{
+    return *reinterpret_cast<size_t*>(slab);
+}
+} // namespace
+
+ReadBufferPool::ReadBufferPool(size_t slabSize, size_t maxCached)
+    : size { slabSize }
+    , maxCached { maxCached }
+{
+    freeSlabs.reserve(maxCached);
+    freeBatchSlabs.reserve(MAX_CACHED_BATCH_SLABS);
+}
+
+ReadBufferPool::~ReadBufferPool()
+{
+    for (auto slab : freeSlabs) {
+        free(slab);
+    }
+    for (auto slab : freeBatchSlabs) {
+        free(slab);
+    }
+}
+
+char* ReadBufferPool::take(std::vector<char*>& freeList, size_t len)
+{
+    counters.outstanding++;
+    if (!freeList.empty()) {
+        auto slab = freeList.back();
+        freeList.pop_back();
+        if (slabLength(slab) >= len) {
+            counters.reuses++;
+            return slab + SLAB_HEADER;
+        }
+        counters.heapFrees++;
+        free(slab);
+    }
+    counters.heapAllocations++;
+    auto slab = reinterpret_cast<char*>(malloc(SLAB_HEADER + len));
+    if (slab == nullptr) {
+        counters.outstanding--;
+        return nullptr;
+    }
+    slabLength(slab) = len;
+    return slab + SLAB_HEADER;
+}
+
+void ReadBufferPool::give(std::vector<char*>& freeList, char* slab, size_t cached)
+{
+    counters.outstanding--;
+    if (freeList.size() < cached) {
+        freeList.push_back(slab);
+        return;
+    }
+    counters.heapFrees++;
+    free(slab);
+}
+
+char* ReadBufferPool::allocate(size_t suggested, size_t& len)
+{
+    if (suggested <= size) {
+        len = size;
+        return take(freeSlabs, size);
+    }
+    len = (suggested + size - 1) / size * size;
+    auto data = take(freeBatchSlabs, len);
+    if (data)
+        len = slabLength(data - SLAB_HEADER);
+    return data;
+}
+
+void ReadBufferPool::deallocate(char* data) noexcept
+{
+    if (data == nullptr)
+        return;
+    auto slab = data - SLAB_HEADER;
+    if (slabLength(slab) == size)
+        give(freeSlabs, slab, maxCached);
+    else
+        give(freeBatchSlabs, slab, MAX_CACHED_BATCH_SLABS);
+}
+
+const ReadBufferPool::Stats& ReadBufferPool::stats() const
+{
+    return counters;
+}
+
+size_t ReadBufferPool::slabSize() const
+{
+    return size;
+}
@@ -0,0 +1,71 @@
+#ifndef BUFFERPOOL_HPP
+#define BUFFERPOOL_HPP
+#include "uvw/loop.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+// Free list of Buffer storage blocks. Every thread (one per event loop) owns its own list,
+// so blocks are recycled without locking. Blocks are malloc'ed and may be realloc'ed by the owner.
+// Blocks of Buffer::BUF_DEFAULT_CAPACITY and of BPOOL_CHUNK_CAPACITY are pooled, other sizes are not.
+class BufferPool
+{
+public:
+    // gives the block back to the pool when the write request is done with it.
+    struct StorageDeleter
+    {
+        size_t capacity = 0;
+        void operator()(char* data) const;
+    };
+    using Storage = std::unique_ptr<char[], StorageDeleter>;
+
+    static char* acquire(size_t capacity);
+    static void recycle(char* data, size_t capacity);
+    static size_t pooledCount();
+    static size_t pooledChunkCount();
+
+public:
+    static constexpr size_t MAX_POOLED_BLOCKS = 64;
+};
+
+// Fixed size slabs for the reads of every TCP/UDP handle of one loop, installed with
+// uvw::Loop::readBufferAllocator. Must outlive the handles of the loop.
+// Requests larger than a slab (recvmmsg batches) get a multiple of the slab size from a second list.
+class ReadBufferPool : public uvw::ReadBufferAllocator
+{
+public:
+    struct Stats
+    {
+        uint64_t heapAllocations = 0; // slabs malloc'ed because the free list was empty
+        uint64_t reuses = 0; // slabs served from the free list
+        uint64_t heapFrees = 0; // slabs freed because the free list was full
+        size_t outstanding = 0; // slabs lent to libuv or to a data event
+    };
+
+    explicit ReadBufferPool(size_t slabSize = DEFAULT_SLAB_SIZE, size_t maxCached = DEFAULT_MAX_CACHED);
+    ~ReadBufferPool() override;
+    ReadBufferPool(const ReadBufferPool&) = delete;
+    ReadBufferPool& operator=(const ReadBufferPool&) = delete;
+
+    char* allocate(size_t suggested, size_t& len) override;
+    void deallocate(char* data) noexcept override;
+    const Stats& stats() const;
+    size_t slabSize() const;
+
+public:
+    // what libuv suggests for both TCP and UDP reads.
+    static constexpr size_t DEFAULT_SLAB_SIZE = 64 * 1024;
+    static constexpr size_t DEFAULT_MAX_CACHED = 256;
+
+private:
+    char* take(std::vector<char*>& freeList, size_t len);
+    void give(std::vector<char*>& freeList, char* slab, size_t cached);
+
+    size_t size;
+    size_t maxCached;
+    std::vector<char*> freeSlabs;
+    std::vector<char*> freeBatchSlabs;
+    Stats counters;
+};
+#endif // BUFFERPOOL_HPP
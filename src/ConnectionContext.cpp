@@ -3,83 +3,62 @@
 #include "Buffer.hpp"
 #include "LogHelper.h"
 #include "uvw/tcp.h"
-namespace
-{
-void dummyDisposeEncCtx(cipher_ctx_t*)
-{
-}
-
-} // namespace
+#include "uvw/timer.h"
 
 ConnectionContext::ConnectionContext(std::shared_ptr<uvw::TCPHandle> tcpHandle, CipherEnv* cipherEnvPtr)
     : cipherEnvPtr(cipherEnvPtr)
-    , localBuf { new Buffer }
-    , e_ctx { nullptr, dummyDisposeEncCtx }
-    , d_ctx { nullptr, dummyDisposeEncCtx }
     , client(std::move(tcpHandle))
 {
 }
 
-ConnectionContext::ConnectionContext()
-    : localBuf {}
-    , e_ctx { nullptr, dummyDisposeEncCtx }
-    , d_ctx {
-        nullptr, dummyDisposeEncCtx
-    }
-{
-}
-
-ConnectionContext::ConnectionContext(ConnectionContext&& that) noexcept
-    : obfsClassPtr(that.obfsClassPtr)
-    , cipherEnvPtr(that.cipherEnvPtr)
-    , localBuf { std::move(that.localBuf) }
-    , remoteBuf { std::move(that.remoteBuf) }
-    , e_ctx { std::move(that.e_ctx) }
-    , d_ctx { std::move(
-          that.d_ctx) }
-    , client(std::move(that.client))
-    , remote(std::move(that.remote))
-{
-}
-
-ConnectionContext& ConnectionContext::operator=(ConnectionContext&& that) noexcept
+void ConnectionContext::setRemoteTcpHandle(std::shared_ptr<uvw::TCPHandle> tcp)
 {
-
-    localBuf = std::move(that.localBuf);
-    remoteBuf = std::move(that.remoteBuf);
-    e_ctx = std::move(that.e_ctx);
-    d_ctx = std::move(that.d_ctx);
-    client = std::move(that.client);
-    remote = std::move(that.remote);
-    obfsClassPtr = that.obfsClassPtr;
-    cipherEnvPtr = that.cipherEnvPtr;
-    return *this;
+    remote = std::move(tcp);
 }
 
-void ConnectionContext::setRemoteTcpHandle(std::shared_ptr<uvw::TCPHandle> tcp)
+size_t ConnectionContext::bufferBytes()
 {
-    remote = std::move(tcp);
+    size_t bytes = localBuf.capacity() + remoteBuf.capacity();
+    if (cipherReady && d_ctx.chunk)
+        bytes += d_ctx.chunk->capacity;
+    if (client)
+        bytes += client->writeQueueSize();
+    if (remote)
+        bytes += remote->writeQueueSize();
+    return bytes + clientRetained + remoteRetained;
 }
 
 void ConnectionContext::construct_cipher(CipherEnv& cipherEnv)
 {
-    if (cipherEnv.crypto) {
+    if (cipherEnv.crypto && !cipherReady) {
         auto crypto = cipherEnv.crypto;
-        auto encCtxRelease = [this, crypto](cipher_ctx_t* p) {
-            if (p == nullptr)
-                return;
-            crypto->ctx_release(p);
-            free(p);
-        };
-        e_ctx = { reinterpret_cast<cipher_ctx_t*>(malloc(sizeof(cipher_ctx_t))), encCtxRelease };
-        d_ctx = { reinterpret_cast<cipher_ctx_t*>(malloc(sizeof(cipher_ctx_t))), encCtxRelease };
-        crypto->ctx_init(crypto->cipher, e_ctx.get(), 1);
-        crypto->ctx_init(crypto->cipher, d_ctx.get(), 0);
+        crypto->ctx_init(crypto->cipher, &e_ctx, 1);
+        crypto->ctx_init(crypto->cipher, &d_ctx, 0);
+        cipherEnvPtr = &cipherEnv;
+        cipherReady = true;
     }
 }
 
 ConnectionContext::~ConnectionContext()
 {
+    if (cipherReady) {
+        cipherEnvPtr->crypto->ctx_release(&e_ctx);
+        cipherEnvPtr->crypto->ctx_release(&d_ctx);
+    }
+    if (coalesceTimer) {
+        coalesceTimer->clear();
+        coalesceTimer->stop();
+        coalesceTimer->close();
+    }
+    if (fallbackTimer) {
+        fallbackTimer->clear();
+        fallbackTimer->stop();
+        fallbackTimer->close();
+    }
+    if (fallbackRemote) {
+        fallbackRemote->clear();
+        fallbackRemote->close();
+    }
     if (remote) {
         remote->clear();
         remote->close();
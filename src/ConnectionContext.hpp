@@ -10,35 +10,58 @@ extern "C"
 namespace uvw
 {
 class TCPHandle;
+class TimerHandle;
 }
 #include "Buffer.hpp"
+#include "TimerWheel.hpp"
 
-#include <functional>
-class ConnectionContext
+// the entry is the connect or idle timeout of the connection in the timer wheel of its loop.
+// the cipher states and the buffer headers are members, a connection is one object in the connection
+// slab of its loop. only the buffer blocks come from BufferPool. it does not move once constructed,
+// the cipher states point into themselves.
+class alignas(64) ConnectionContext : public TimerWheel::Entry
 {
 private:
     ObfsClass* obfsClassPtr = nullptr;
     CipherEnv* cipherEnvPtr = nullptr;
+    bool cipherReady = false; // e_ctx and d_ctx are initialized
 
 public:
-    using cihper_ctx_release_t = std::function<void(cipher_ctx_t*)>;
-    std::unique_ptr<Buffer> localBuf;
-    std::unique_ptr<Buffer> remoteBuf;
-    std::unique_ptr<cipher_ctx_t, cihper_ctx_release_t> e_ctx;
-    std::unique_ptr<cipher_ctx_t, cihper_ctx_release_t> d_ctx;
+    cipher_ctx_t e_ctx;
+    cipher_ctx_t d_ctx;
+    Buffer localBuf;
+    Buffer remoteBuf;
     std::shared_ptr<uvw::TCPHandle> client;
     std::shared_ptr<uvw::TCPHandle> remote;
+    uint64_t slabId = 0; // the id in the connection slab of its loop
+    bool established = false; // the remote is connected, the idle timeout applies
+    bool fastOpen = false; // remote was opened with TCP fast open, the outcome is counted on the first reply
+    // happy eyeballs: the connect to the other address family, racing remote until one of them wins.
+    std::shared_ptr<uvw::TCPHandle> fallbackRemote;
+    std::shared_ptr<uvw::TimerHandle> fallbackTimer; // pending start of fallbackRemote
+    sockaddr_storage fallbackAddr {};
+    // set while the target address waits in localBuf for the first client data to share its chunk.
+    std::shared_ptr<uvw::TimerHandle> coalesceTimer;
+    // backpressure: reading from one side stops while the other side has too much left to write.
+    bool clientPaused = false; // client reads wait for the remote write queue to drain
+    bool remotePaused = false; // remote reads wait for the client write queue to drain
+    size_t peakQueued = 0; // largest write queue of either side, in bytes
+    // a vectored write keeps its whole read slab and pool block until it is done, these count what they
+    // hold beyond the bytes still queued, so the watermarks and bufferBytes see it.
+    size_t clientRetained = 0; // of the writes to client
+    size_t remoteRetained = 0; // of the writes to remote
 
     ConnectionContext(std::shared_ptr<uvw::TCPHandle> tcpHandle, CipherEnv* cipherEnvPtr);
 
-    ConnectionContext();
+    ConnectionContext(const ConnectionContext&) = delete;
 
-    ConnectionContext(ConnectionContext&&) noexcept;
-
-    ConnectionContext& operator=(ConnectionContext&&) noexcept;
+    ConnectionContext& operator=(const ConnectionContext&) = delete;
 
     void construct_cipher(CipherEnv& cipherEnv);
     void setRemoteTcpHandle(std::shared_ptr<uvw::TCPHandle> tcp);
+    // memory held for the data of this connection: buffer blocks, a partial frame, the queued writes and
+    // what vectored writes retain beyond them.
+    size_t bufferBytes();
 
     ~ConnectionContext();
 };
@@ -0,0 +1,111 @@
+#include "DNSResolver.hpp"
+
+#include "uvw/dns.h"
+#include "uvw/loop.h"
+#include <cstring>
+
+DNSResolver::DNSResolver(std::shared_ptr<uvw::Loop> loop, uint64_t ttlMs)
+    : loop(std::move(loop))
+    , ttlMs(ttlMs)
+    , cache(std::make_shared<Cache>())
+{
+}
+
+DNSResolver::~DNSResolver()
+{
+    cancel();
+}
+
+void DNSResolver::resolve(const std::string& host, int port, bool ipv6first, Callback callback)
+{
+    sockaddr_storage addr {}, none {};
+    if (uv_ip4_addr(host.c_str(), port, reinterpret_cast<sockaddr_in*>(&addr)) == 0) {
+        callback(AF_INET, addr, none);
+        return;
+    }
+    if (uv_ip6_addr(host.c_str(), port, reinterpret_cast<sockaddr_in6*>(&addr)) == 0) {
+        callback(AF_INET6, addr, none);
+        return;
+    }
+    auto key = host + '|' + std::to_string(port) + (ipv6first ? "|6" : "|4");
+    auto& entry = (*cache)[key];
+    if (entry.request) {
+        entry.waiters.push_back(std::move(callback));
+        return;
+    }
+    if (entry.af != -1 && loop->now().count() < entry.expiry) {
+        callback(entry.af, entry.addr, entry.alternative);
+        return;
+    }
+    entry.waiters.push_back(std::move(callback));
+    entry.request = loop->resource<uvw::GetAddrInfoReq>();
+    std::weak_ptr<Cache> weakCache = cache;
+    entry.request->once<uvw::AddrInfoEvent>([weakCache, key, ipv6first, ttl = ttlMs](auto& e, auto& req) {
+        auto cache = weakCache.lock();
+        if (!cache)
+            return;
+        sockaddr_storage addr {}, alternative {};
+        int af = ssr_select_addr_info(e.data.get(), &addr, ipv6first, &alternative);
+        complete(*cache, key, af, addr, alternative, req.loop().now().count() + ttl);
+    });
+    entry.request->once<uvw::ErrorEvent>([weakCache, key](auto&, auto&) {
+        auto cache = weakCache.lock();
+        if (!cache)
+            return;
+        complete(*cache, key, -1, sockaddr_storage {}, sockaddr_storage {}, 0);
+    });
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    // the request may fail right away, entry is not used after this.
+    auto request = entry.request;
+    request->addrInfo(host, std::to_string(port), &hints);
+}
+
+void DNSResolver::cancel()
+{
+    for (auto& [key, entry] : *cache) {
+        if (!entry.request)
+            continue;
+        entry.request->cancel();
+        entry.waiters.clear();
+    }
+}
+
+size_t DNSResolver::cacheSize() const
+{
+    return cache->size();
+}
+
+uint64_t DNSResolver::ttl() const
+{
+    return ttlMs;
+}
+
+void DNSResolver::complete(Cache& cache, const std::string& key, int af, const sockaddr_storage& addr,
+    const sockaddr_storage& alternative, uint64_t expiry)
+{
+    auto it = cache.find(key);
+    if (it == cache.end())
+        return;
+    auto& entry = it->second;
+    entry.request.reset();
+    if (af != -1) {
+        entry.af = af;
+        entry.addr = addr;
+        entry.alternative = alternative;
+        entry.expiry = expiry;
+    }
+    // a failed refresh keeps serving the stale answer.
+    int resultAf = entry.af;
+    sockaddr_storage result = entry.addr;
+    sockaddr_storage resultAlternative = entry.alternative;
+    auto waiters = std::move(entry.waiters);
+    entry.waiters.clear();
+    if (resultAf == -1)
+        cache.erase(it);
+    // callbacks may resolve again and rehash the cache.
+    for (auto& callback : waiters)
+        callback(resultAf, result, resultAlternative);
+}
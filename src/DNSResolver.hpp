@@ -0,0 +1,63 @@
+#ifndef DNSRESOLVER_HPP
+#define DNSRESOLVER_HPP
+#include "NetUtils.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace uvw
+{
+class Loop;
+class GetAddrInfoReq;
+}
+
+// Resolves host names on the libuv threadpool and caches the answers of one loop.
+// getaddrinfo does not report record TTLs, so every answer is kept for the same ttl.
+// Lookups of a name that is already being resolved wait for that request.
+class DNSResolver
+{
+public:
+    // af is AF_INET or AF_INET6, or -1 when the name could not be resolved.
+    // alternative is an address of the other family, its ss_family is 0 when there is none.
+    using Callback = std::function<void(int af, const sockaddr_storage& addr, const sockaddr_storage& alternative)>;
+
+    explicit DNSResolver(std::shared_ptr<uvw::Loop> loop, uint64_t ttlMs = DEFAULT_TTL_MS);
+    ~DNSResolver();
+    DNSResolver(const DNSResolver&) = delete;
+    DNSResolver& operator=(const DNSResolver&) = delete;
+
+    // ip literals and fresh cache entries are answered before resolve returns.
+    void resolve(const std::string& host, int port, bool ipv6first, Callback callback);
+    // gives up on requests that have not started, their callbacks are never called.
+    void cancel();
+    size_t cacheSize() const;
+    uint64_t ttl() const;
+
+public:
+    static constexpr uint64_t DEFAULT_TTL_MS = 60 * 1000;
+
+private:
+    struct Entry
+    {
+        int af = -1;
+        sockaddr_storage addr {};
+        sockaddr_storage alternative {};
+        uint64_t expiry = 0; // loop time the answer goes stale at
+        std::shared_ptr<uvw::GetAddrInfoReq> request; // set while a lookup is running
+        std::vector<Callback> waiters;
+    };
+    using Cache = std::unordered_map<std::string, Entry>;
+
+    static void complete(Cache& cache, const std::string& key, int af, const sockaddr_storage& addr,
+        const sockaddr_storage& alternative, uint64_t expiry);
+
+    std::shared_ptr<uvw::Loop> loop;
+    uint64_t ttlMs;
+    // shared with the running requests, which must not touch it once the resolver is gone.
+    std::shared_ptr<Cache> cache;
+};
+#endif // DNSRESOLVER_HPP
@@ -2,10 +2,18 @@
 #include "ssrutils.h"
 #include "uvw/dns.h"
 #include "uvw/loop.h"
+#include <cerrno>
 #include <cstring>
+#if defined(__linux__)
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
 
-int ssr_get_sock_addr(std::shared_ptr<uvw::Loop> loop, const char* host, int port, struct sockaddr_storage* storage, int ipv6first)
+int ssr_get_sock_addr(std::shared_ptr<uvw::Loop> loop, const char* host, int port, struct sockaddr_storage* storage, int ipv6first,
+    struct sockaddr_storage* alternative)
 {
+    if (alternative)
+        alternative->ss_family = 0;
     if (uv_ip4_addr(host, port, reinterpret_cast<sockaddr_in*>(storage)) == 0) {
         return AF_INET;
     }
@@ -21,36 +29,83 @@ int ssr_get_sock_addr(std::shared_ptr<uvw::Loop> loop, const char* host, int por
     hints.ai_family = AF_UNSPEC;
     hints.ai_socktype = SOCK_STREAM;
     auto dns_res = getAddrInfoReq->addrInfoSync(host, digitBuffer, &hints);
+    int af = dns_res.first ? ssr_select_addr_info(dns_res.second.get(), storage, ipv6first, alternative) : -1;
+    if (af == -1)
+        LOGE("DNS not resolved %s:%d", host, port);
+    return af;
+}
+
+int ssr_select_addr_info(const struct addrinfo* res, struct sockaddr_storage* storage, int ipv6first,
+    struct sockaddr_storage* alternative)
+{
+    if (alternative)
+        alternative->ss_family = 0;
     int prefer_af = ipv6first ? AF_INET6 : AF_INET;
-    int af=AF_INET;
-    if (dns_res.first) {
-        struct addrinfo* rp = nullptr;
-        for (rp = dns_res.second.get(); rp != nullptr; rp = rp->ai_next)
-            if (rp->ai_family == prefer_af) {
-                if (rp->ai_family == AF_INET)
-                    af=AF_INET,memcpy(storage, rp->ai_addr, sizeof(struct sockaddr_in));
-                else if (rp->ai_family == AF_INET6)
-                    af=AF_INET6,memcpy(storage, rp->ai_addr, sizeof(struct sockaddr_in6));
+    const struct addrinfo* rp = nullptr;
+    for (rp = res; rp != nullptr; rp = rp->ai_next)
+        if (rp->ai_family == prefer_af)
+            break;
+    if (rp == nullptr) {
+        //fallback: if we can't find prefered AF, then we choose alternative.
+        for (rp = res; rp != nullptr; rp = rp->ai_next)
+            if (rp->ai_family == AF_INET || rp->ai_family == AF_INET6)
                 break;
-            }
-        if (rp == nullptr) {
-            //fallback: if we can't find prefered AF, then we choose alternative.
-            for (rp = dns_res.second.get(); rp != nullptr; rp = rp->ai_next) {
-                if (rp->ai_family == AF_INET)
-                    af=AF_INET,memcpy(storage, rp->ai_addr, sizeof(struct sockaddr_in));
-                else if (rp->ai_family == AF_INET6)
-                    af=AF_INET6,memcpy(storage, rp->ai_addr, sizeof(struct sockaddr_in6));
+    }
+    if (rp == nullptr)
+        return -1; // dns not resolved
+    if (rp->ai_family == AF_INET)
+        memcpy(storage, rp->ai_addr, sizeof(struct sockaddr_in));
+    else
+        memcpy(storage, rp->ai_addr, sizeof(struct sockaddr_in6));
+    if (alternative) {
+        int other_af = rp->ai_family == AF_INET ? AF_INET6 : AF_INET;
+        for (const struct addrinfo* ap = res; ap != nullptr; ap = ap->ai_next) {
+            if (ap->ai_family == other_af) {
+                memcpy(alternative, ap->ai_addr, other_af == AF_INET ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6));
                 break;
             }
         }
-        if (rp == nullptr) {
-            LOGE("DNS not resolved %s:%d", host, port);
-            return -1; // dns not resolved
-        }
-        return af;
-    } else {
-        LOGE("DNS not resolved %s:%d", host, port);
-        return -1; // dns not resolved
     }
-    return -1;
+    return rp->ai_family;
+}
+
+int ssr_set_reuse_port(uv_os_fd_t fd)
+{
+#if defined(SO_REUSEPORT) && !defined(_WIN32)
+    int opt = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)
+        return uv_translate_sys_error(errno);
+    return 0;
+#else
+    (void)fd;
+    return UV_ENOTSUP;
+#endif
+}
+
+int ssr_set_fast_open_connect(uv_os_fd_t fd)
+{
+#if defined(__linux__) && defined(TCP_FASTOPEN_CONNECT)
+    int opt = 1;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &opt, sizeof(opt)) < 0)
+        return uv_translate_sys_error(errno);
+    return 0;
+#else
+    (void)fd;
+    return UV_ENOTSUP;
+#endif
+}
+
+int ssr_fast_open_accepted(uv_os_fd_t fd)
+{
+#if defined(__linux__) && defined(TCPI_OPT_SYN_DATA)
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    memset(&info, 0, sizeof(info));
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) < 0)
+        return uv_translate_sys_error(errno);
+    return (info.tcpi_options & TCPI_OPT_SYN_DATA) ? 1 : 0;
+#else
+    (void)fd;
+    return UV_ENOTSUP;
+#endif
 }
@@ -1,14 +1,33 @@
 #pragma once
 #if defined(_WIN32)
 #include <winsock2.h>
+#include <ws2tcpip.h>
 #else
+#include <netdb.h>
 #include <sys/socket.h>
 #endif
 #include <memory>
+#include <uv.h>
 
 namespace uvw
 {
 class Loop;
 }
 
-int ssr_get_sock_addr(std::shared_ptr<uvw::Loop> loop, const char* host, int port, struct sockaddr_storage* storage, int ipv6first);
+// alternative, if given, receives an address of the other family, ss_family is 0 when there is none.
+int ssr_get_sock_addr(std::shared_ptr<uvw::Loop> loop, const char* host, int port, struct sockaddr_storage* storage, int ipv6first,
+    struct sockaddr_storage* alternative = nullptr);
+
+// copies the first address of the preferred family, or of the other one, out of a getaddrinfo result.
+// returns the address family, -1 if there is none.
+int ssr_select_addr_info(const struct addrinfo* res, struct sockaddr_storage* storage, int ipv6first,
+    struct sockaddr_storage* alternative = nullptr);
+
+// let several sockets bind the same address, the kernel balances incoming connections between them.
+int ssr_set_reuse_port(uv_os_fd_t fd);
+
+// TCP_FASTOPEN_CONNECT: connect() returns at once and the first write goes out with the SYN.
+int ssr_set_fast_open_connect(uv_os_fd_t fd);
+
+// after the handshake: 1 if the server acked the data in the SYN, 0 if it was sent again, a uv error otherwise.
+int ssr_fast_open_accepted(uv_os_fd_t fd);
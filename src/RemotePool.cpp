@@ -0,0 +1,112 @@
+#include "RemotePool.hpp"
+
+#include "uvw/loop.h"
+#include "uvw/tcp.h"
+#include "uvw/timer.h"
+#include <algorithm>
+#include <cstring>
+
+RemotePool::RemotePool(std::shared_ptr<uvw::Loop> loop, size_t size, uint64_t maxIdleMs)
+    : loop(std::move(loop))
+    , size(size)
+    , maxIdleMs(maxIdleMs ? maxIdleMs : DEFAULT_MAX_IDLE_MS)
+{
+    expiryTimer = this->loop->resource<uvw::TimerHandle>();
+    expiryTimer->on<uvw::TimerEvent>([this](auto&, auto&) { expire(); });
+    auto interval = uvw::TimerHandle::Time { std::max<uint64_t>(this->maxIdleMs / 4, 100) };
+    expiryTimer->start(interval, interval);
+}
+
+RemotePool::~RemotePool()
+{
+    expiryTimer->clear();
+    expiryTimer->stop();
+    expiryTimer->close();
+    for (auto& entry : idle)
+        close(*entry.handle);
+    for (auto& handle : connecting)
+        close(*handle);
+}
+
+void RemotePool::fill(const sockaddr_storage& addr)
+{
+    size_t len = addr.ss_family == AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+    if (addr.ss_family != target.ss_family || memcmp(&addr, &target, len) != 0) {
+        for (auto& entry : idle)
+            close(*entry.handle);
+        for (auto& handle : connecting)
+            close(*handle);
+        idle.clear();
+        connecting.clear();
+        target = addr;
+    }
+    // a connect can fail inside connect() and leave connecting as it was, the expiry timer retries it.
+    for (size_t n = idle.size() + connecting.size(); n < size; ++n)
+        connect();
+}
+
+RemotePool::Connection RemotePool::take()
+{
+    if (idle.empty())
+        return {};
+    // the newest one, it is the least likely to have been dropped by the server.
+    auto entry = std::move(idle.back());
+    idle.pop_back();
+    entry.handle->clear();
+    entry.handle->stop();
+    return { std::move(entry.handle), entry.connectMs };
+}
+
+size_t RemotePool::idleCount() const
+{
+    return idle.size();
+}
+
+void RemotePool::connect()
+{
+    auto handle = loop->resource<uvw::TCPHandle>();
+    connecting.push_back(handle);
+    auto start = loop->now().count();
+    handle->once<uvw::ConnectEvent>([this, start](auto&, uvw::TCPHandle& h) {
+        auto it = std::find_if(connecting.begin(), connecting.end(), [&h](auto& c) { return c.get() == &h; });
+        if (it == connecting.end())
+            return;
+        auto now = loop->now().count();
+        idle.push_back({ std::move(*it), now, now - start });
+        connecting.erase(it);
+        // nothing is expected before the first request, reading only notices a close.
+        h.read();
+    });
+    handle->once<uvw::ErrorEvent>([this](auto&, uvw::TCPHandle& h) { drop(h); });
+    handle->once<uvw::EndEvent>([this](auto&, uvw::TCPHandle& h) { drop(h); });
+    handle->once<uvw::DataEvent>([this](auto&, uvw::TCPHandle& h) { drop(h); });
+    handle->noDelay(true);
+    handle->connect(reinterpret_cast<const sockaddr&>(target));
+}
+
+void RemotePool::drop(uvw::TCPHandle& handle)
+{
+    auto same = [&handle](auto& h) { return h.get() == &handle; };
+    connecting.erase(std::remove_if(connecting.begin(), connecting.end(), same), connecting.end());
+    idle.erase(std::remove_if(idle.begin(), idle.end(), [&same](auto& entry) { return same(entry.handle); }), idle.end());
+    close(handle);
+}
+
+void RemotePool::expire()
+{
+    auto now = loop->now().count();
+    while (!idle.empty() && now - idle.front().connectedAt >= maxIdleMs) {
+        close(*idle.front().handle);
+        idle.pop_front();
+    }
+    // also retries the connects that failed since the last round.
+    if (target.ss_family != 0)
+        fill(target);
+}
+
+void RemotePool::close(uvw::TCPHandle& handle)
+{
+    handle.clear();
+    if (!handle.closing())
+        handle.close();
+}
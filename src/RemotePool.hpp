@@ -0,0 +1,65 @@
+#ifndef REMOTEPOOL_HPP
+#define REMOTEPOOL_HPP
+#include "NetUtils.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace uvw
+{
+class Loop;
+class TCPHandle;
+class TimerHandle;
+}
+
+// Connections to the server opened before they are needed, so a new SOCKS5 CONNECT skips the
+// TCP handshake. Idle connections are read to notice when the server drops them and are
+// closed after maxIdleMs, before a server side timeout could hit them.
+class RemotePool
+{
+public:
+    struct Connection
+    {
+        std::shared_ptr<uvw::TCPHandle> handle; // nullptr when the pool was empty
+        uint64_t connectMs = 0; // how long its handshake took, the latency a hit saves
+    };
+
+    RemotePool(std::shared_ptr<uvw::Loop> loop, size_t size, uint64_t maxIdleMs);
+    ~RemotePool();
+    RemotePool(const RemotePool&) = delete;
+    RemotePool& operator=(const RemotePool&) = delete;
+
+    // opens connections to addr until size of them are idle or connecting, at most one attempt per
+    // missing connection. connections to a previous address are dropped.
+    void fill(const sockaddr_storage& addr);
+    // a connected handle with its events cleared and reading stopped, the caller takes it over.
+    Connection take();
+    size_t idleCount() const;
+
+public:
+    static constexpr uint64_t DEFAULT_MAX_IDLE_MS = 10 * 1000;
+
+private:
+    struct Idle
+    {
+        std::shared_ptr<uvw::TCPHandle> handle;
+        uint64_t connectedAt = 0;
+        uint64_t connectMs = 0;
+    };
+
+    void connect();
+    void drop(uvw::TCPHandle& handle);
+    void expire();
+    static void close(uvw::TCPHandle& handle);
+
+    std::shared_ptr<uvw::Loop> loop;
+    size_t size;
+    uint64_t maxIdleMs;
+    sockaddr_storage target {};
+    std::deque<Idle> idle; // oldest first
+    std::vector<std::shared_ptr<uvw::TCPHandle>> connecting;
+    std::shared_ptr<uvw::TimerHandle> expiryTimer;
+};
+#endif // REMOTEPOOL_HPP
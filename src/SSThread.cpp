@@ -75,9 +75,14 @@ void SSThread::run()
     profile.mtu = mtu;
     profile.mode = mode;
     profile.acl = nullptr;
-    profile.fast_open = 1; // libuv is not supported fastopen yet.
+    profile.fast_open = 1; // falls back to a normal connect where the kernel does not support it.
     profile.verbose = verbose;
     profile.ipv6first = ipv6first;
+    profile.workers = 1;
+    profile.udp_offload = 0;
+    profile.remote_pool = 0;
+    profile.remote_pool_idle = 0;
+    profile.coalesce_window = 1;
     tcpRelay->loopMain(profile);
 }
 
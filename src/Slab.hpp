@@ -0,0 +1,111 @@
+#ifndef SLAB_HPP
+#define SLAB_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <new>
+#include <utility>
+
+// Objects of one type in slots that are reused through a free list, so creating and destroying
+// them does not allocate once the slab has grown. Objects never move, references to them stay
+// valid until they are erased. An id carries the generation of its slot: the id of an erased
+// object is not found again, even after the slot was given to another object.
+template <typename T>
+class Slab
+{
+public:
+    using Id = uint64_t;
+
+    Slab() = default;
+    ~Slab() { clear(); }
+    Slab(const Slab&) = delete;
+    Slab& operator=(const Slab&) = delete;
+
+    template <typename... Args>
+    Id emplace(Args&&... args)
+    {
+        uint32_t index;
+        if (freeHead != NONE) {
+            index = freeHead;
+            freeHead = slots[index].nextFree;
+        } else {
+            index = static_cast<uint32_t>(slots.size());
+            slots.emplace_back();
+        }
+        Slot& slot = slots[index];
+        new (slot.storage) T(std::forward<Args>(args)...);
+        slot.live = true;
+        ++count;
+        return (static_cast<Id>(slot.generation) << 32) | index;
+    }
+
+    // nullptr once the object was erased.
+    T* find(Id id)
+    {
+        auto index = static_cast<uint32_t>(id);
+        if (index >= slots.size())
+            return nullptr;
+        Slot& slot = slots[index];
+        if (!slot.live || slot.generation != static_cast<uint32_t>(id >> 32))
+            return nullptr;
+        return slot.value();
+    }
+
+    // erasing an object that is gone already does nothing, also from within its own destructor.
+    void erase(Id id)
+    {
+        T* object = find(id);
+        if (!object)
+            return;
+        auto index = static_cast<uint32_t>(id);
+        Slot& slot = slots[index];
+        slot.live = false;
+        ++slot.generation;
+        --count;
+        object->~T();
+        slot.nextFree = freeHead;
+        freeHead = index;
+    }
+
+    void clear()
+    {
+        for (size_t i = 0; i < slots.size(); ++i) {
+            if (slots[i].live)
+                erase((static_cast<Id>(slots[i].generation) << 32) | i);
+        }
+    }
+
+    template <typename F>
+    void forEach(F&& f)
+    {
+        for (auto& slot : slots) {
+            if (slot.live)
+                f(*slot.value());
+        }
+    }
+
+    size_t size() const { return count; }
+
+    // slots ever created, live or free.
+    size_t capacity() const { return slots.size(); }
+
+private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct Slot
+    {
+        alignas(T) unsigned char storage[sizeof(T)];
+        uint32_t generation = 0;
+        uint32_t nextFree = NONE;
+        bool live = false;
+
+        T* value() { return std::launder(reinterpret_cast<T*>(storage)); }
+    };
+
+    // a deque never moves its elements when it grows.
+    std::deque<Slot> slots;
+    uint32_t freeHead = NONE;
+    size_t count = 0;
+};
+#endif // SLAB_HPP
@@ -1,12 +1,30 @@
 #pragma once
 #include "shadowsocks.h"
+#include <cstdint>
 #include <memory>
 
 class TCPRelay
 {
 public:
+    struct Stats
+    {
+        uint64_t connectTimeouts = 0; // connections closed before the remote was connected
+        uint64_t idleTimeouts = 0; // connections closed after profile_t::timeout without traffic
+        uint64_t fastOpenAccepted = 0; // the server took the data sent with the SYN
+        uint64_t fastOpenFallbacks = 0; // the data was sent again after the handshake, or TFO could not be set up
+        uint64_t poolHits = 0; // connects served by an already open remote connection
+        uint64_t poolMisses = 0; // connects that found the remote pool empty
+        uint64_t poolSavedMs = 0; // handshake time of the pooled connections that were used
+        uint64_t backpressurePauses = 0; // times a side stopped reading because the other could not keep up
+        uint64_t peakQueuedBytes = 0; // largest write queue of any connection
+        // buffer memory: the most the connections held at once, sampled every second, and how many they were.
+        uint64_t peakBufferBytes = 0;
+        uint64_t peakBufferConnections = 0;
+    };
+
     virtual ~TCPRelay() = default;
     virtual void stop() = 0;
     virtual int loopMain(profile_t&) = 0;
+    virtual Stats stats() const = 0;
     static std::shared_ptr<TCPRelay> create();
 };
\ No newline at end of file
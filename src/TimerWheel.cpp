@@ -0,0 +1,172 @@
+#include "TimerWheel.hpp"
+
+#include <algorithm>
+
+TimerWheel::Entry::~Entry()
+{
+    if (wheel)
+        wheel->cancel(*this);
+}
+
+bool TimerWheel::Entry::scheduled() const
+{
+    return wheel != nullptr;
+}
+
+TimerWheel::TimerWheel(uint64_t tickMs, ExpireCallback onExpire)
+    : tick(std::max<uint64_t>(tickMs, 1))
+    , onExpire(std::move(onExpire))
+{
+    for (auto& level : slots) {
+        for (auto& slot : level)
+            slot.prev = slot.next = &slot;
+    }
+}
+
+TimerWheel::~TimerWheel()
+{
+    for (auto& level : slots) {
+        for (auto& slot : level) {
+            while (slot.next != &slot) {
+                auto& entry = static_cast<Entry&>(*slot.next);
+                unlink(entry);
+                entry.wheel = nullptr;
+            }
+        }
+    }
+}
+
+void TimerWheel::schedule(Entry& entry, uint64_t timeoutMs, uint64_t nowMs)
+{
+    uint64_t now = nowMs / tick;
+    // nothing is pending, so the wheel can jump straight to now.
+    if (count == 0)
+        current = std::max(current, now);
+    uint64_t deadline = std::max(now + (timeoutMs + tick - 1) / tick, current + 1);
+    if (entry.wheel == this) {
+        entry.deadline = deadline;
+        // later than its slot: it is moved when the slot comes up.
+        if (deadline >= entry.slotTick)
+            return;
+        unlink(entry);
+    } else {
+        if (entry.wheel)
+            entry.wheel->cancel(entry);
+        entry.wheel = this;
+        entry.deadline = deadline;
+        ++count;
+    }
+    insert(entry);
+}
+
+void TimerWheel::cancel(Entry& entry)
+{
+    if (entry.wheel != this)
+        return;
+    unlink(entry);
+    entry.wheel = nullptr;
+    --count;
+}
+
+void TimerWheel::advance(uint64_t nowMs)
+{
+    uint64_t target = nowMs / tick;
+    while (current < target) {
+        if (count == 0) {
+            current = target;
+            break;
+        }
+        ++current;
+        for (unsigned level = LEVELS - 1; level > 0; --level) {
+            if ((current & ((uint64_t { 1 } << (LEVEL_BITS * level)) - 1)) == 0)
+                cascade(level);
+        }
+        expire(slots[0][current & (SLOTS - 1)]);
+    }
+}
+
+size_t TimerWheel::size() const
+{
+    return count;
+}
+
+uint64_t TimerWheel::expiredCount() const
+{
+    return expired;
+}
+
+uint64_t TimerWheel::tickMs() const
+{
+    return tick;
+}
+
+void TimerWheel::insert(Entry& entry)
+{
+    uint64_t delta = entry.deadline - current;
+    unsigned level = 0;
+    while (level < LEVELS - 1 && delta >= (uint64_t { 1 } << (LEVEL_BITS * (level + 1))))
+        ++level;
+    // beyond the last level: park it in the farthest slot, it is rescheduled from there.
+    uint64_t at = std::min(entry.deadline, current + (uint64_t { 1 } << (LEVEL_BITS * LEVELS)) - 1);
+    unsigned shift = LEVEL_BITS * level;
+    entry.slotTick = at & ~((uint64_t { 1 } << shift) - 1);
+    pushBack(slots[level][(at >> shift) & (SLOTS - 1)], entry);
+}
+
+void TimerWheel::cascade(unsigned level)
+{
+    Node pending;
+    splice(slots[level][(current >> (LEVEL_BITS * level)) & (SLOTS - 1)], pending);
+    while (pending.next != &pending) {
+        auto& entry = static_cast<Entry&>(*pending.next);
+        unlink(entry);
+        insert(entry);
+    }
+}
+
+void TimerWheel::expire(Node& slot)
+{
+    Node pending;
+    splice(slot, pending);
+    // pop one at a time, a callback may destroy entries still pending here.
+    while (pending.next != &pending) {
+        auto& entry = static_cast<Entry&>(*pending.next);
+        unlink(entry);
+        if (entry.deadline > current) {
+            insert(entry);
+            continue;
+        }
+        entry.wheel = nullptr;
+        --count;
+        ++expired;
+        onExpire(entry);
+    }
+}
+
+void TimerWheel::unlink(Node& node)
+{
+    node.prev->next = node.next;
+    node.next->prev = node.prev;
+    node.prev = node.next = nullptr;
+}
+
+void TimerWheel::pushBack(Node& head, Node& node)
+{
+    node.prev = head.prev;
+    node.next = &head;
+    head.prev->next = &node;
+    head.prev = &node;
+}
+
+void TimerWheel::splice(Node& from, Node& to)
+{
+    if (from.next == &from) {
+        to.prev = to.next = &to;
+        return;
+    }
+    to.next = from.next;
+    to.prev = from.prev;
+    to.next->prev = &to;
+    to.prev->next = &to;
+    from.prev = from.next = &from;
+}
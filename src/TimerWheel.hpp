@@ -0,0 +1,75 @@
+#ifndef TIMERWHEEL_HPP
+#define TIMERWHEEL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// Hierarchical timer wheel for many timeouts of one loop, driven by a single repeating timer
+// that calls advance(). Four levels of 64 slots each cover 2^24 ticks.
+// Touching an entry only moves its deadline, the entry is rescheduled when its slot comes up,
+// so refreshing a timeout on every packet is O(1) and never reorders a heap.
+class TimerWheel
+{
+public:
+    struct Node
+    {
+        Node* prev = nullptr;
+        Node* next = nullptr;
+    };
+
+    // embedded in the owner of the timeout, unlinks itself when destroyed.
+    class Entry : private Node
+    {
+    public:
+        Entry() = default;
+        Entry(const Entry&) = delete;
+        Entry& operator=(const Entry&) = delete;
+        ~Entry();
+        bool scheduled() const;
+
+    private:
+        friend class TimerWheel;
+        TimerWheel* wheel = nullptr;
+        uint64_t deadline = 0; // tick the entry expires at
+        uint64_t slotTick = 0; // tick its slot is processed at
+    };
+
+    using ExpireCallback = std::function<void(Entry&)>;
+
+    TimerWheel(uint64_t tickMs, ExpireCallback onExpire);
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+    ~TimerWheel();
+
+    // (re)arms the entry to expire timeoutMs after nowMs, rounded up to the next tick.
+    void schedule(Entry& entry, uint64_t timeoutMs, uint64_t nowMs);
+    void cancel(Entry& entry);
+    // expires everything due at nowMs, the callback may schedule, cancel or destroy any entry.
+    void advance(uint64_t nowMs);
+
+    size_t size() const;
+    uint64_t expiredCount() const;
+    uint64_t tickMs() const;
+
+public:
+    static constexpr unsigned LEVEL_BITS = 6;
+    static constexpr unsigned LEVELS = 4;
+    static constexpr size_t SLOTS = size_t { 1 } << LEVEL_BITS;
+
+private:
+    void insert(Entry& entry);
+    void cascade(unsigned level);
+    void expire(Node& slot);
+    static void unlink(Node& node);
+    static void pushBack(Node& head, Node& node);
+    static void splice(Node& from, Node& to);
+
+    uint64_t tick;
+    uint64_t current = 0; // last processed tick
+    size_t count = 0;
+    uint64_t expired = 0;
+    ExpireCallback onExpire;
+    Node slots[LEVELS][SLOTS];
+};
+#endif // TIMERWHEEL_HPP
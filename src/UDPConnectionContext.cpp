@@ -4,10 +4,10 @@
 
 UDPConnectionContext::~UDPConnectionContext()
 {
-    if(timeoutTimer)
-    {
-        timeoutTimer->stop();
-        timeoutTimer->close();
+    if (groPoll) {
+        groPoll->clear();
+        groPoll->stop();
+        groPoll->close();
     }
     if (remote) {
         remote->clear();
@@ -20,20 +20,6 @@ UDPConnectionContext::UDPConnectionContext(uvw::Addr addr, std::shared_ptr<uvw::
     , remoteBuf(std::make_unique<Buffer>())
     , remote(std::move(remoteSocket))
 {
-}
-void UDPConnectionContext::initTimer(std::shared_ptr<uvw::Loop>& loop, std::function<void()> panic, uvw::TimerHandle::Time timeout)
-{
-    timeoutTimer = loop->resource<uvw::TimerHandle>();
-    timeoutTimer->on<uvw::TimerEvent>([addr = srcAddr, panic = std::move(panic)](auto&, uvw::TimerHandle& h) {
-        h.stop();
-        h.close();
-        //before we panic, we must stop and close silently.
-        panic(); //destroy this UDPConnectionContext instance.
-    });
-    timeoutTimer->start(timeout, timeout);
-}
-void UDPConnectionContext::resetTimeoutTimer()
-{
-    if (timeoutTimer)
-        timeoutTimer->again();
+    if (uv_ip4_addr(srcAddr.ip.c_str(), srcAddr.port, reinterpret_cast<sockaddr_in*>(&srcSockAddr)) != 0)
+        uv_ip6_addr(srcAddr.ip.c_str(), srcAddr.port, reinterpret_cast<sockaddr_in6*>(&srcSockAddr));
 }
@@ -2,23 +2,25 @@
 #define SHADOWSOCKSR_UVW_UDPCONNECTIONCONTEXT_HPP
 #include <memory>
 
+#include "TimerWheel.hpp"
 #include "uvw/loop.h"
-#include "uvw/timer.h"
+#include "uvw/poll.h"
 #include "uvw/udp.h"
 
 class Buffer;
 
-class UDPConnectionContext
+// the entry is the idle timeout of the session in the timer wheel of its UDPRelay.
+class UDPConnectionContext : public TimerWheel::Entry
 {
 public:
-    std::shared_ptr<uvw::TimerHandle> timeoutTimer;
     uvw::Addr srcAddr;
+    sockaddr_storage srcSockAddr {}; // srcAddr, resolved once for the replies
     std::unique_ptr<Buffer> remoteBuf;
     std::shared_ptr<uvw::UDPHandle> remote;
+    // reads remote with recvmsg when UDP_GRO is on, libuv would hide the segment size.
+    std::shared_ptr<uvw::PollHandle> groPoll;
     UDPConnectionContext() = default;
     UDPConnectionContext(uvw::Addr addr, std::shared_ptr<uvw::UDPHandle> remoteSocket);
-    void initTimer(std::shared_ptr<uvw::Loop>& loop, std::function<void()> panic, uvw::TimerHandle::Time timeout);
-    void resetTimeoutTimer();
     ~UDPConnectionContext();
 };
 
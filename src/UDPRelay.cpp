@@ -6,6 +6,26 @@
 #include "ssrutils.h"
 #include "uvw/dns.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#if defined(__linux__)
+#define SSR_UVW_WITH_SENDMMSG
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif
+
 #if defined(IP_TOS) && !defined(_WIN32)
 #define SET_IP_TOS(h)                                                      \
     do {                                                                   \
@@ -40,10 +60,28 @@ UDPRelay::UDPRelay(std::shared_ptr<uvw::Loop> loop, CipherEnv& cipherEnv, const
     : loop(std::move(loop))
     , cipherEnvPtr(&cipherEnv)
     , timeout { profile.timeout }
+    , sessionTimeouts { std::clamp<uint64_t>(profile.timeout / 8, 1, SESSION_TICK_MS), [this](auto& entry) { expireSession(entry); } }
 {
+    if (profile.udp_offload) {
+#ifdef SSR_UVW_WITH_SENDMMSG
+        gsoEnabled = true;
+        groEnabled = true;
+#else
+        LOGI("[udp] GSO/GRO is not supported on this platform");
+#endif
+    }
 }
 UDPRelay::~UDPRelay()
 {
+    pendingDatagrams.clear();
+    if (flushHandle) {
+        flushHandle->stop();
+        flushHandle->close();
+    }
+    if (sessionTimer) {
+        sessionTimer->stop();
+        sessionTimer->close();
+    }
     socketCache.clear();
     if (protocol_global) {
         free(protocol_global);
@@ -61,7 +99,17 @@ int UDPRelay::initUDPRelay(int mtu, const char* host, int port, struct sockaddr_
         packet_size = mtu - PACKET_HEADER_SIZE;
         buf_size = packet_size * 2;
     }
-    udpServer = loop->resource<uvw::UDPHandle>();
+    udpServer = createSocket();
+    localBuf = std::make_unique<Buffer>();
+    flushHandle = loop->resource<uvw::CheckHandle>();
+    flushHandle->on<uvw::CheckEvent>([this](auto&, auto&) { flushPending(); });
+    sessionTimer = loop->resource<uvw::TimerHandle>();
+    sessionTimer->on<uvw::TimerEvent>([this](auto&, auto& handle) {
+        sessionTimeouts.advance(loop->now().count());
+        if (sessionTimeouts.size() == 0)
+            handle.stop();
+    });
+    startTime = loop->now().count();
     udpServer->on<uvw::ErrorEvent>([this](auto& e, auto& h) {
         LOGE("[udp]local error %s", e.what());
     });
@@ -73,7 +121,6 @@ int UDPRelay::initUDPRelay(int mtu, const char* host, int port, struct sockaddr_
     udpServer->bind(reinterpret_cast<const sockaddr&>(localStorage), uvw::Flags<uvw::UDPHandle::Bind>::from<uvw::UDPHandle::Bind::REUSEADDR>());
     SET_IP_TOS(udpServer);
     udpServer->on<uvw::UDPDataEvent>([this](auto& e, auto& h) {
-        localBuf = std::make_unique<Buffer>();
         serverRecv(e, h);
     });
     udpServer->recv();
@@ -146,7 +193,7 @@ void UDPRelay::serverRecv(uvw::UDPDataEvent& data, uvw::UDPHandle& handle)
     }
     std::shared_ptr<UDPConnectionContext> remoteCtx;
     if (socketCache.find(data.sender) == socketCache.end()) {
-        auto remoteSocket = loop->resource<uvw::UDPHandle>();
+        auto remoteSocket = createSocket();
         remoteSocket->on<uvw::ErrorEvent>([this](auto& e, auto& h) {
             LOGE("[udp]remote error %s", e.what());
         });
@@ -168,26 +215,24 @@ void UDPRelay::serverRecv(uvw::UDPDataEvent& data, uvw::UDPHandle& handle)
         }
         SET_IP_TOS(remoteSocket);
         remoteCtx = std::make_shared<UDPConnectionContext>(data.sender, remoteSocket);
-        remoteCtx->initTimer(
-            loop, [this, addr = data.sender]() { panic(addr); }, uvw::TimerHandle::Time { timeout });
         socketCache.insert({ data.sender, remoteCtx });
-        remoteSocket->on<uvw::UDPDataEvent>([this, addr = data.sender](auto& e, auto& h) {
-            this->remoteRecv(e, h, addr);
-        });
-        remoteSocket->recv();
+        touchSession(*remoteCtx);
+        if (!groEnabled || !startGroReceive(*remoteCtx, data.sender)) {
+            remoteSocket->on<uvw::UDPDataEvent>([this, addr = data.sender](auto& e, auto& h) {
+                this->remoteRecv(e, h, addr);
+            });
+            remoteSocket->recv();
+        }
     } else {
         remoteCtx = socketCache[data.sender];
-        remoteCtx->resetTimeoutTimer();
-    }
-    if (offset > 0) {
-        localBuf->copyFromBegin(data.data.get() + offset, data.length - offset);
+        touchSession(*remoteCtx);
     }
-    int err = localBuf->ssEncryptAll(*cipherEnvPtr);
+    int err = localBuf->ssEncryptAll(*cipherEnvPtr, data.data.get() + offset, data.length - offset);
     if (err) {
         panic(data.sender);
         return;
     }
-    remoteCtx->remote->send(reinterpret_cast<const sockaddr&>(remoteAddr), localBuf->duplicateDataToArray(), localBuf->length());
+    queueSend(remoteCtx->remote, reinterpret_cast<const sockaddr&>(remoteAddr), localBuf->duplicateDataToArray(), localBuf->length(), remoteCtx->groPoll != nullptr);
     localBuf->setLength(0);
 }
 void UDPRelay::panic(const uvw::Addr& addr)
@@ -195,15 +240,50 @@ void UDPRelay::panic(const uvw::Addr& addr)
     if (socketCache.find(addr) != socketCache.end())
         socketCache.erase(addr);
 }
+void UDPRelay::touchSession(UDPConnectionContext& ctx)
+{
+    sessionTimeouts.schedule(ctx, timeout, loop->now().count());
+    if (!sessionTimer->active()) {
+        auto tick = uvw::TimerHandle::Time { sessionTimeouts.tickMs() };
+        sessionTimer->start(tick, tick);
+    }
+}
+void UDPRelay::expireSession(TimerWheel::Entry& entry)
+{
+    // copied, erasing the context destroys its own address.
+    auto addr = static_cast<UDPConnectionContext&>(entry).srcAddr;
+    panic(addr);
+}
+void UDPRelay::remoteAddress(const sockaddr_storage& addr)
+{
+    // remote sockets are bound to the old family and can not reach the new one.
+    if (addr.ss_family != remoteAddr.ss_family)
+        socketCache.clear();
+    remoteAddr = addr;
+}
+UDPRelay::Stats UDPRelay::stats() const
+{
+    Stats stats;
+    stats.sessions = socketCache.size();
+    stats.expired = sessionTimeouts.expiredCount();
+    auto elapsed = loop->now().count() - startTime;
+    if (elapsed > 0)
+        stats.expiredPerSecond = stats.expired * 1000.0 / elapsed;
+    stats.dropped = droppedDatagrams;
+    return stats;
+}
 void UDPRelay::remoteRecv(uvw::UDPDataEvent& data, uvw::UDPHandle& handle, const uvw::Addr& localSrcAddr)
+{
+    remoteDatagram(data.data.get(), data.length, localSrcAddr);
+}
+void UDPRelay::remoteDatagram(const char* data, size_t length, const uvw::Addr& localSrcAddr)
 {
     if (socketCache.find(localSrcAddr) == socketCache.end()) {
         panic(localSrcAddr);
         return;
     }
     auto& ctx = socketCache[localSrcAddr];
-    ctx->remoteBuf->copy(data);
-    int err = ctx->remoteBuf->ssDecryptALl(*cipherEnvPtr);
+    int err = ctx->remoteBuf->ssDecryptALl(*cipherEnvPtr, data, length);
     if (err) {
         panic(localSrcAddr);
         return;
@@ -216,10 +296,230 @@ void UDPRelay::remoteRecv(uvw::UDPDataEvent& data, uvw::UDPHandle& handle, const
     }
     auto response = std::make_unique<char[]>(ctx->remoteBuf->length() + 3);
     memcpy(response.get() + 3, ctx->remoteBuf->begin(), ctx->remoteBuf->length());
-    ctx->resetTimeoutTimer();
-    udpServer->send(ctx->srcAddr, std::move(response), ctx->remoteBuf->length() + 3);
+    touchSession(*ctx);
+    queueSend(udpServer, reinterpret_cast<const sockaddr&>(ctx->srcSockAddr), std::move(response), ctx->remoteBuf->length() + 3);
     ctx->remoteBuf->setLength(0);
 }
+bool UDPRelay::startGroReceive(UDPConnectionContext& ctx, const uvw::Addr& localSrcAddr)
+{
+#ifdef SSR_UVW_WITH_SENDMMSG
+    int fd = ctx.remote->fileno();
+    int on = 1;
+    if (setsockopt(fd, SOL_UDP, UDP_GRO, &on, sizeof(on)) < 0) {
+        LOGI("[udp] UDP_GRO is not available (%s), read datagrams one by one", strerror(errno));
+        groEnabled = false;
+        return false;
+    }
+    if (!groBuf)
+        groBuf = std::make_unique<char[]>(GRO_BUF_SIZE);
+    ctx.groPoll = loop->resource<uvw::PollHandle>(uvw::OSSocketHandle { fd });
+    ctx.groPoll->on<uvw::PollEvent>([this, fd, addr = localSrcAddr](auto&, auto&) {
+        groRecv(fd, addr);
+    });
+    ctx.groPoll->start(uvw::PollHandle::Event::READABLE);
+    return true;
+#else
+    (void)ctx;
+    (void)localSrcAddr;
+    return false;
+#endif
+}
+void UDPRelay::groRecv(int fd, const uvw::Addr& localSrcAddr)
+{
+#ifdef SSR_UVW_WITH_SENDMMSG
+    // keep the context, and so the socket, alive while its segments are relayed.
+    auto it = socketCache.find(localSrcAddr);
+    if (it == socketCache.end())
+        return;
+    auto ctx = it->second;
+    // bounded like the read loop of libuv, other handles get their turn.
+    for (int count = 0; count < 32; ++count) {
+        iovec iov { groBuf.get(), GRO_BUF_SIZE };
+        union {
+            cmsghdr align;
+            char buf[CMSG_SPACE(sizeof(int))];
+        } control {};
+        msghdr msg {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        ssize_t nread;
+        do {
+            nread = recvmsg(fd, &msg, MSG_DONTWAIT);
+        } while (nread < 0 && errno == EINTR);
+        if (nread < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                LOGE("[udp]remote error %s", strerror(errno));
+            return;
+        }
+        // the kernel coalesces no more than fits the buffer, anything cut off is not relayed.
+        if (msg.msg_flags & MSG_TRUNC) {
+            ++droppedDatagrams;
+            continue;
+        }
+        size_t segment = static_cast<size_t>(nread);
+        for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+                int gsoSize;
+                memcpy(&gsoSize, CMSG_DATA(cmsg), sizeof(gsoSize));
+                if (gsoSize > 0)
+                    segment = static_cast<size_t>(gsoSize);
+            }
+        }
+        // split the coalesced datagrams before they are decrypted one by one.
+        for (ssize_t offset = 0; offset < nread; offset += segment) {
+            size_t len = std::min(segment, static_cast<size_t>(nread - offset));
+            remoteDatagram(groBuf.get() + offset, len, localSrcAddr);
+            if (ctx->remote->closing()) {
+                // the segments after the one that closed the session have nowhere to go.
+                droppedDatagrams += (nread - offset - len + segment - 1) / segment;
+                return;
+            }
+        }
+        if (nread == 0)
+            return;
+    }
+#else
+    (void)fd;
+    (void)localSrcAddr;
+#endif
+}
+std::shared_ptr<uvw::UDPHandle> UDPRelay::createSocket()
+{
+#if !defined(_WIN32) && UV_VERSION_HEX >= ((1 << 16) | (39 << 8))
+    // libuv drains the socket with recvmmsg where the platform has it, the batch buffer needs
+    // uv_udp_using_recvmmsg to be sized.
+    return loop->resource<uvw::UDPHandle>(static_cast<unsigned int>(UV_UDP_RECVMMSG));
+#else
+    return loop->resource<uvw::UDPHandle>();
+#endif
+}
+void UDPRelay::queueSend(const std::shared_ptr<uvw::UDPHandle>& handle, const sockaddr& addr, std::unique_ptr<char[]> data, unsigned int len, bool polled)
+{
+    PendingDatagram datagram { handle, {}, std::move(data), len, polled };
+    memcpy(&datagram.addr, &addr, addr.sa_family == AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in));
+    if (pendingDatagrams.empty())
+        flushHandle->start();
+    pendingDatagrams.emplace_back(std::move(datagram));
+}
+void UDPRelay::flushPending()
+{
+    size_t i = 0;
+    while (i < pendingDatagrams.size()) {
+        auto handle = pendingDatagrams[i].handle;
+        size_t end = i;
+        while (end < pendingDatagrams.size() && pendingDatagrams[end].handle == handle)
+            ++end;
+        if (handle->closing()) {
+            i = end;
+            continue;
+        }
+#ifdef SSR_UVW_WITH_SENDMMSG
+        // keep the order of datagrams libuv still has queued for this socket.
+        if (uv_udp_get_send_queue_count(handle->raw()) == 0)
+            i = sendBatch(i, end);
+#endif
+        // the poll handle of a GRO socket owns its fd in the loop, what the kernel did not take is lost.
+        if (i < end && pendingDatagrams[i].polled) {
+            droppedDatagrams += end - i;
+            i = end;
+            continue;
+        }
+        // whatever the kernel did not take goes through the libuv send queue.
+        for (; i < end; ++i) {
+            auto& datagram = pendingDatagrams[i];
+            handle->send(reinterpret_cast<const sockaddr&>(datagram.addr), std::move(datagram.data), datagram.len);
+        }
+    }
+    pendingDatagrams.clear();
+    flushHandle->stop();
+}
+size_t UDPRelay::sendBatch(size_t begin, size_t end)
+{
+#ifdef SSR_UVW_WITH_SENDMMSG
+    mmsghdr msgs[MAX_SEND_BATCH];
+    iovec iovs[MAX_SEND_BATCH];
+    // index one past the last datagram carried by each message.
+    size_t msgEnd[MAX_SEND_BATCH];
+    union GsoControl {
+        cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(uint16_t))];
+    } controls[MAX_SEND_BATCH];
+    auto fd = pendingDatagrams[begin].handle->fileno();
+    auto sameAddr = [](const sockaddr_storage& a, const sockaddr_storage& b) {
+        if (a.ss_family != b.ss_family)
+            return false;
+        return memcmp(&a, &b, a.ss_family == AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in)) == 0;
+    };
+    while (begin < end) {
+        size_t msgCount = 0;
+        size_t iovCount = 0;
+        size_t next = begin;
+        while (next < end && msgCount < MAX_SEND_BATCH && iovCount < MAX_SEND_BATCH) {
+            auto& datagram = pendingDatagrams[next];
+            size_t segments = 1;
+            size_t total = datagram.len;
+            // consecutive datagrams to one peer go out as one GSO send, all but the last
+            // one have to be the size of the first.
+            if (gsoEnabled) {
+                while (next + segments < end && segments < MAX_GSO_SEGMENTS && iovCount + segments < MAX_SEND_BATCH) {
+                    auto& prev = pendingDatagrams[next + segments - 1];
+                    auto& cur = pendingDatagrams[next + segments];
+                    if (prev.len != datagram.len || cur.len > datagram.len || total + cur.len > MAX_GSO_PAYLOAD
+                        || !sameAddr(cur.addr, datagram.addr))
+                        break;
+                    total += cur.len;
+                    ++segments;
+                }
+            }
+            auto& msg = msgs[msgCount];
+            memset(&msg, 0, sizeof(mmsghdr));
+            msg.msg_hdr.msg_name = &datagram.addr;
+            msg.msg_hdr.msg_namelen = datagram.addr.ss_family == AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+            msg.msg_hdr.msg_iov = &iovs[iovCount];
+            msg.msg_hdr.msg_iovlen = segments;
+            for (size_t k = 0; k < segments; ++k) {
+                iovs[iovCount + k].iov_base = pendingDatagrams[next + k].data.get();
+                iovs[iovCount + k].iov_len = pendingDatagrams[next + k].len;
+            }
+            if (segments > 1) {
+                memset(&controls[msgCount], 0, sizeof(GsoControl));
+                msg.msg_hdr.msg_control = controls[msgCount].buf;
+                msg.msg_hdr.msg_controllen = sizeof(controls[msgCount].buf);
+                auto cmsg = CMSG_FIRSTHDR(&msg.msg_hdr);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                auto gsoSize = static_cast<uint16_t>(datagram.len);
+                memcpy(CMSG_DATA(cmsg), &gsoSize, sizeof(gsoSize));
+            }
+            iovCount += segments;
+            next += segments;
+            msgEnd[msgCount++] = next;
+        }
+        int sent;
+        do {
+            sent = sendmmsg(fd, msgs, static_cast<unsigned int>(msgCount), 0);
+        } while (sent < 0 && errno == EINTR);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+                break;
+            if (msgs[0].msg_hdr.msg_iovlen > 1 && (errno == EIO || errno == EINVAL || errno == EOPNOTSUPP)) {
+                // the kernel or the device can not segment, send the datagrams one by one from now on.
+                LOGI("[udp] UDP_SEGMENT is not available (%s), send datagrams one by one", strerror(errno));
+                gsoEnabled = false;
+                continue;
+            }
+            // the first message is bad, drop it like a failed uv_udp_send would.
+            LOGE("[udp] sendmmsg failed: %s", strerror(errno));
+            sent = 1;
+        }
+        begin = msgEnd[sent - 1];
+    }
+#endif
+    return begin;
+}
 int UDPRelay::parseUDPRelayHeader(const char* buf, size_t buf_len, char* host, char* port, struct sockaddr_storage* storage)
 {
     const uint8_t atyp = *(uint8_t*)buf;
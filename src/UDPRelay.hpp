@@ -3,10 +3,14 @@
 
 #include <memory>
 
+#include "TimerWheel.hpp"
+#include "uvw/check.h"
 #include "uvw/loop.h"
+#include "uvw/timer.h"
 #include "uvw/udp.h"
 #include <cstdint>
 #include <unordered_map>
+#include <vector>
 
 extern "C"
 {
@@ -44,17 +48,51 @@ private:
 
     void remoteRecv(uvw::UDPDataEvent& data, uvw::UDPHandle& handle, const uvw::Addr& localSrcAddr);
 
+    void remoteDatagram(const char* data, size_t length, const uvw::Addr& localSrcAddr);
+
+    bool startGroReceive(UDPConnectionContext& ctx, const uvw::Addr& localSrcAddr);
+
+    void groRecv(int fd, const uvw::Addr& localSrcAddr);
+
     void panic(const uvw::Addr& addr);
 
     void serverRecv(uvw::UDPDataEvent& data, uvw::UDPHandle& handle);
 
+    std::shared_ptr<uvw::UDPHandle> createSocket();
+
+    // datagrams are queued while the loop dispatches a batch of reads and flushed together once per
+    // loop iteration, with sendmmsg where available.
+    // polled: the socket is read through a poll handle, so libuv must not watch it for sends.
+    void queueSend(const std::shared_ptr<uvw::UDPHandle>& handle, const sockaddr& addr, std::unique_ptr<char[]> data, unsigned int len, bool polled = false);
+
+    void flushPending();
+
+    size_t sendBatch(size_t begin, size_t end);
+
+    void touchSession(UDPConnectionContext& ctx);
+
+    void expireSession(TimerWheel::Entry& entry);
+
 public:
+    struct Stats
+    {
+        size_t sessions = 0; // client addresses with a remote socket
+        uint64_t expired = 0; // sessions closed by the idle timeout
+        double expiredPerSecond = 0;
+        uint64_t dropped = 0; // datagrams read or queued that were never relayed
+    };
+
     UDPRelay(std::shared_ptr<uvw::Loop> loop, CipherEnv& cipherEnv, const profile_t& profile);
 
     ~UDPRelay();
 
     int initUDPRelay(int mtu, const char* host, int port, struct sockaddr_storage remote_addr);
 
+    // the server moved, new datagrams go to addr.
+    void remoteAddress(const sockaddr_storage& addr);
+
+    Stats stats() const;
+
 private:
     CipherEnv* cipherEnvPtr;
 
@@ -66,6 +104,12 @@ private:
     void* protocol_global = nullptr;
     int timeout;
     static constexpr int MAX_UDP_PACKET_SIZE = 65507;
+    // one wheel and one uv timer for the idle timeouts of all sessions.
+    TimerWheel sessionTimeouts;
+    std::shared_ptr<uvw::TimerHandle> sessionTimer;
+    uint64_t startTime = 0;
+    uint64_t droppedDatagrams = 0;
+    static constexpr uint64_t SESSION_TICK_MS = 1000;
     std::unique_ptr<Buffer> localBuf;
     std::shared_ptr<uvw::Loop> loop;
     std::shared_ptr<uvw::UDPHandle> udpServer;
@@ -73,6 +117,24 @@ private:
     int packet_size { DEFAULT_PACKET_SIZE };
     int buf_size { DEFAULT_PACKET_SIZE * 2 };
     sockaddr_storage remoteAddr {};
+    struct PendingDatagram
+    {
+        std::shared_ptr<uvw::UDPHandle> handle;
+        sockaddr_storage addr;
+        std::unique_ptr<char[]> data;
+        unsigned int len;
+        bool polled;
+    };
+    std::vector<PendingDatagram> pendingDatagrams;
+    std::shared_ptr<uvw::CheckHandle> flushHandle;
+    static constexpr size_t MAX_SEND_BATCH = 64;
+    // GSO/GRO, each one is switched off for good when the kernel rejects it.
+    bool gsoEnabled = false;
+    bool groEnabled = false;
+    std::unique_ptr<char[]> groBuf;
+    static constexpr size_t MAX_GSO_SEGMENTS = 64;
+    static constexpr size_t MAX_GSO_PAYLOAD = 65000;
+    static constexpr size_t GRO_BUF_SIZE = 65536;
 };
 
 #endif //SHADOWSOCKSR_UVW_UDPRELAY_HPP
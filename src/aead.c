@@ -33,6 +33,7 @@
 #include <sodium.h>
 
 #include "aead.h"
+#include "aesgcm.h"
 #include "ppbloom.h"
 #include "ssrutils.h"
 #include <uv.h>
@@ -55,6 +56,28 @@
 #define CHUNK_SIZE_LEN 2
 #define CHUNK_SIZE_MASK 0x3FFF
 
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+
+/*
+ * The primitive that seals the frames of a session. The frame loops below are compiled once per kernel
+ * with the kernel as a constant, so the switch in aead_cipher_* folds away and the primitive is called
+ * directly. AES-GCM has its own kernel when the CPU has AES-NI and PCLMULQDQ, otherwise it goes through
+ * mbed TLS. AES-256-GCM stays with libsodium unless the VAES path is there, on AES-NI alone libsodium
+ * is the faster one.
+ */
+#define KERNEL_GCM 0
+#define KERNEL_AESGCM 1
+#define KERNEL_CHACHA20POLY1305IETF 2
+#define KERNEL_XCHACHA20POLY1305IETF 3
+#define KERNEL_AES256GCM 4
+
+#if defined(_MSC_VER)
+#define AEAD_INLINE static __forceinline
+#else
+#define AEAD_INLINE static inline __attribute__((always_inline))
+#endif
+
 /*
  * Spec: http://shadowsocks.org/en/spec/AEAD-Ciphers.html
  *
@@ -152,7 +175,7 @@ static const int supported_aead_ciphers_tag_size[AEAD_CIPHER_NUM] = {
 #endif
 };
 
-static int
+AEAD_INLINE int
 aead_cipher_encrypt(cipher_ctx_t* cipher_ctx,
     uint8_t* c,
     size_t* clen,
@@ -161,7 +184,8 @@ aead_cipher_encrypt(cipher_ctx_t* cipher_ctx,
     uint8_t* ad,
     size_t adlen,
     uint8_t* n,
-    uint8_t* k)
+    uint8_t* k,
+    int kernel)
 {
     int err = CRYPTO_OK;
     unsigned long long long_clen = 0;
@@ -169,30 +193,30 @@ aead_cipher_encrypt(cipher_ctx_t* cipher_ctx,
     size_t nlen = cipher_ctx->cipher->nonce_len;
     size_t tlen = cipher_ctx->cipher->tag_len;
 
-    switch (cipher_ctx->cipher->method) {
-    case AES256GCM: // Only AES-256-GCM is supported by libsodium.
-        if (cipher_ctx->aes256gcm_ctx != NULL) { // Use it if availble
-            err = crypto_aead_aes256gcm_encrypt_afternm(c, &long_clen, m, mlen,
-                ad, adlen, NULL, n,
-                (const aes256gcm_ctx*)cipher_ctx->aes256gcm_ctx);
-            *clen = (size_t)long_clen; // it's safe to cast 64bit to 32bit length here
-            break;
-        }
+    switch (kernel) {
+    case KERNEL_AES256GCM: // Only AES-256-GCM is supported by libsodium.
+        err = crypto_aead_aes256gcm_encrypt_afternm(c, &long_clen, m, mlen,
+            ad, adlen, NULL, n,
+            (const aes256gcm_ctx*)cipher_ctx->aes256gcm_ctx);
+        *clen = (size_t)long_clen; // it's safe to cast 64bit to 32bit length here
+        break;
+    case KERNEL_AESGCM:
+        aesgcm_encrypt_detached(cipher_ctx->aesgcm_ctx, c, c + mlen, m, mlen, ad, adlen, n);
+        *clen = mlen + tlen;
+        break;
     // Otherwise, just use the mbedTLS one with crappy AES-NI.
-    case AES192GCM:
-    case AES128GCM:
-
+    case KERNEL_GCM:
         err = mbedtls_cipher_auth_encrypt(cipher_ctx->evp, n, nlen, ad, adlen,
             m, mlen, c, clen, c + mlen, tlen);
         *clen += tlen;
         break;
-    case CHACHA20POLY1305IETF:
+    case KERNEL_CHACHA20POLY1305IETF:
         err = crypto_aead_chacha20poly1305_ietf_encrypt(c, &long_clen, m, mlen,
             ad, adlen, NULL, n, k);
         *clen = (size_t)long_clen;
         break;
 #ifdef FS_HAVE_XCHACHA20IETF
-    case XCHACHA20POLY1305IETF:
+    case KERNEL_XCHACHA20POLY1305IETF:
         err = crypto_aead_xchacha20poly1305_ietf_encrypt(c, &long_clen, m, mlen,
             ad, adlen, NULL, n, k);
         *clen = (size_t)long_clen;
@@ -205,12 +229,60 @@ aead_cipher_encrypt(cipher_ctx_t* cipher_ctx,
     return err;
 }
 
-static int
+/* like aead_cipher_encrypt without additional data, the tag goes to mac. c may be m. */
+AEAD_INLINE int
+aead_cipher_encrypt_detached(cipher_ctx_t* cipher_ctx,
+    uint8_t* c,
+    uint8_t* mac,
+    uint8_t* m,
+    size_t mlen,
+    uint8_t* n,
+    uint8_t* k,
+    int kernel)
+{
+    int err = CRYPTO_OK;
+    size_t olen = 0;
+
+    size_t nlen = cipher_ctx->cipher->nonce_len;
+    size_t tlen = cipher_ctx->cipher->tag_len;
+
+    switch (kernel) {
+    case KERNEL_AES256GCM:
+        err = crypto_aead_aes256gcm_encrypt_detached_afternm(c, mac, NULL, m, mlen,
+            NULL, 0, NULL, n,
+            (const aes256gcm_ctx*)cipher_ctx->aes256gcm_ctx);
+        break;
+    case KERNEL_AESGCM:
+        aesgcm_encrypt_detached(cipher_ctx->aesgcm_ctx, c, mac, m, mlen, NULL, 0, n);
+        break;
+    case KERNEL_GCM:
+        err = mbedtls_cipher_auth_encrypt(cipher_ctx->evp, n, nlen, NULL, 0,
+            m, mlen, c, &olen, mac, tlen);
+        break;
+    case KERNEL_CHACHA20POLY1305IETF:
+        err = crypto_aead_chacha20poly1305_ietf_encrypt_detached(c, mac, NULL, m, mlen,
+            NULL, 0, NULL, n, k);
+        break;
+#ifdef FS_HAVE_XCHACHA20IETF
+    case KERNEL_XCHACHA20POLY1305IETF:
+        err = crypto_aead_xchacha20poly1305_ietf_encrypt_detached(c, mac, NULL, m, mlen,
+            NULL, 0, NULL, n, k);
+        break;
+#endif
+    default:
+        return CRYPTO_ERROR;
+    }
+
+    return err;
+}
+
+AEAD_INLINE int
 aead_cipher_decrypt(cipher_ctx_t* cipher_ctx,
     uint8_t* p, size_t* plen,
     uint8_t* m, size_t mlen,
     uint8_t* ad, size_t adlen,
-    uint8_t* n, uint8_t* k)
+    uint8_t* n, uint8_t* k,
+    int kernel)
 {
     int err = CRYPTO_ERROR;
     unsigned long long long_plen = 0;
@@ -218,28 +290,32 @@ aead_cipher_decrypt(cipher_ctx_t* cipher_ctx,
     size_t nlen = cipher_ctx->cipher->nonce_len;
     size_t tlen = cipher_ctx->cipher->tag_len;
 
-    switch (cipher_ctx->cipher->method) {
-    case AES256GCM: // Only AES-256-GCM is supported by libsodium.
-        if (cipher_ctx->aes256gcm_ctx != NULL) { // Use it if availble
-            err = crypto_aead_aes256gcm_decrypt_afternm(p, &long_plen, NULL, m, mlen,
-                ad, adlen, n,
-                (const aes256gcm_ctx*)cipher_ctx->aes256gcm_ctx);
-            *plen = (size_t)long_plen; // it's safe to cast 64bit to 32bit length here
+    switch (kernel) {
+    case KERNEL_AES256GCM: // Only AES-256-GCM is supported by libsodium.
+        err = crypto_aead_aes256gcm_decrypt_afternm(p, &long_plen, NULL, m, mlen,
+            ad, adlen, n,
+            (const aes256gcm_ctx*)cipher_ctx->aes256gcm_ctx);
+        *plen = (size_t)long_plen; // it's safe to cast 64bit to 32bit length here
+        break;
+    case KERNEL_AESGCM:
+        if (mlen < tlen)
             break;
-        }
+        err = aesgcm_decrypt_detached(cipher_ctx->aesgcm_ctx, p, m, mlen - tlen,
+            m + mlen - tlen, ad, adlen, n);
+        *plen = mlen - tlen;
+        break;
     // Otherwise, just use the mbedTLS one with crappy AES-NI.
-    case AES192GCM:
-    case AES128GCM:
+    case KERNEL_GCM:
         err = mbedtls_cipher_auth_decrypt(cipher_ctx->evp, n, nlen, ad, adlen,
             m, mlen - tlen, p, plen, m + mlen - tlen, tlen);
         break;
-    case CHACHA20POLY1305IETF:
+    case KERNEL_CHACHA20POLY1305IETF:
         err = crypto_aead_chacha20poly1305_ietf_decrypt(p, &long_plen, NULL, m, mlen,
             ad, adlen, n, k);
         *plen = (size_t)long_plen; // it's safe to cast 64bit to 32bit length here
         break;
 #ifdef FS_HAVE_XCHACHA20IETF
-    case XCHACHA20POLY1305IETF:
+    case KERNEL_XCHACHA20POLY1305IETF:
         err = crypto_aead_xchacha20poly1305_ietf_decrypt(p, &long_plen, NULL, m, mlen,
             ad, adlen, n, k);
         *plen = (size_t)long_plen; // it's safe to cast 64bit to 32bit length here
@@ -285,15 +361,21 @@ aead_get_cipher_type(int method)
     return mbedtls_cipher_info_from_string(mbedtlsname);
 }
 
+/* the kernel of an AES-GCM method, aead_kernel() and the context storage follow the same choice */
+static int
+aead_gcm_kernel(int method)
+{
+    if (method == AES256GCM && crypto_aead_aes256gcm_is_available() && !aesgcm_has_vaes())
+        return KERNEL_AES256GCM;
+    if (aesgcm_is_available())
+        return KERNEL_AESGCM;
+    return KERNEL_GCM;
+}
+
 static void
 aead_cipher_ctx_set_key(cipher_ctx_t* cipher_ctx, int enc)
 {
-    const digest_type_t* md = mbedtls_md_info_from_string("SHA1");
-    if (md == NULL) {
-        FATAL("SHA1 Digest not found in crypto library");
-    }
-
-    int err = crypto_hkdf(md,
+    int err = crypto_hkdf_sha1(
         cipher_ctx->salt, cipher_ctx->cipher->key_len,
         cipher_ctx->cipher->key, cipher_ctx->cipher->key_len,
         (uint8_t*)SUBKEY_INFO, strlen(SUBKEY_INFO),
@@ -316,6 +398,14 @@ aead_cipher_ctx_set_key(cipher_ctx_t* cipher_ctx, int enc)
         }
         return;
     }
+    if (cipher_ctx->aesgcm_ctx != NULL) {
+        if (aesgcm_beforenm(cipher_ctx->aesgcm_ctx, cipher_ctx->skey,
+                cipher_ctx->cipher->key_len)
+            != 0) {
+            FATAL("Cannot set AES-GCM cipher key");
+        }
+        return;
+    }
     if (mbedtls_cipher_setkey(cipher_ctx->evp, cipher_ctx->skey,
             cipher_ctx->cipher->key_len * 8, enc)
         != 0) {
@@ -342,13 +432,15 @@ aead_cipher_ctx_init(cipher_ctx_t* cipher_ctx, int method, int enc)
 
     const cipher_kt_t* cipher = aead_get_cipher_type(method);
 
-    if (method == AES256GCM && crypto_aead_aes256gcm_is_available()) {
-        cipher_ctx->aes256gcm_ctx = ss_aligned_malloc(sizeof(aes256gcm_ctx));
-        memset(cipher_ctx->aes256gcm_ctx, 0, sizeof(aes256gcm_ctx));
+    int kernel = aead_gcm_kernel(method);
+    cipher_ctx->aes256gcm_ctx = NULL;
+    cipher_ctx->aesgcm_ctx = NULL;
+    if (kernel == KERNEL_AES256GCM) {
+        cipher_ctx->aes256gcm_ctx = &cipher_ctx->state.aes256gcm;
+    } else if (kernel == KERNEL_AESGCM) {
+        cipher_ctx->aesgcm_ctx = &cipher_ctx->state.aesgcm;
     } else {
-        cipher_ctx->aes256gcm_ctx = NULL;
-        cipher_ctx->evp = ss_malloc(sizeof(cipher_evp_t));
-        memset(cipher_ctx->evp, 0, sizeof(cipher_evp_t));
+        cipher_ctx->evp = &cipher_ctx->state.evp;
         cipher_evp_t* evp = cipher_ctx->evp;
         mbedtls_cipher_init(evp);
         if (mbedtls_cipher_setup(evp, cipher) != 0) {
@@ -378,28 +470,51 @@ void aead_ctx_init(cipher_t* cipher, cipher_ctx_t* cipher_ctx, int enc)
     }
 }
 
+/* the chunk holds ciphertext that does not make a whole frame yet, its block goes back to the pool as
+ * soon as every frame is opened */
+static void
+aead_chunk_release(cipher_ctx_t* cipher_ctx)
+{
+    if (cipher_ctx->chunk == NULL)
+        return;
+    bpool_recycle(cipher_ctx->chunk->data, cipher_ctx->chunk->capacity);
+    cipher_ctx->chunk = NULL;
+}
+
+/* a chunk always has room for a whole frame, so a frame is completed where it starts. the pool recycles
+ * blocks of BPOOL_CHUNK_CAPACITY, which fits the frames of every method. */
+static buffer_t*
+aead_chunk_acquire(cipher_ctx_t* cipher_ctx, size_t capacity)
+{
+    if (cipher_ctx->chunk != NULL)
+        return cipher_ctx->chunk;
+    size_t max_chunk_len = 2 * cipher_ctx->cipher->tag_len + CHUNK_SIZE_LEN + CHUNK_SIZE_MASK;
+    buffer_t* chunk = &cipher_ctx->chunk_buf;
+    memset(chunk, 0, sizeof(buffer_t));
+    chunk->capacity = max(capacity, max(max_chunk_len, BPOOL_CHUNK_CAPACITY));
+    chunk->data = bpool_acquire(chunk->capacity);
+    cipher_ctx->chunk = chunk;
+    return chunk;
+}
+
 void aead_ctx_release(cipher_ctx_t* cipher_ctx)
 {
-    if (cipher_ctx->chunk != NULL) {
-        bfree(cipher_ctx->chunk);
-        ss_free(cipher_ctx->chunk);
-        cipher_ctx->chunk = NULL;
-    }
+    aead_chunk_release(cipher_ctx);
 
     if (cipher_ctx->cipher->method >= CHACHA20POLY1305IETF) {
         return;
     }
 
-    if (cipher_ctx->aes256gcm_ctx != NULL) {
-        ss_aligned_free(cipher_ctx->aes256gcm_ctx);
+    if (cipher_ctx->aes256gcm_ctx != NULL || cipher_ctx->aesgcm_ctx != NULL) {
         return;
     }
 
     mbedtls_cipher_free(cipher_ctx->evp);
-    ss_free(cipher_ctx->evp);
 }
 
-int aead_encrypt_all(buffer_t* plaintext, cipher_t* cipher, size_t capacity)
+AEAD_INLINE int
+aead_encrypt_all_kernel(const buffer_t* plaintext, buffer_t* ciphertext, cipher_t* cipher, size_t capacity,
+    int kernel)
 {
     cipher_ctx_t cipher_ctx;
     aead_ctx_init(cipher, &cipher_ctx, 1);
@@ -408,10 +523,7 @@ int aead_encrypt_all(buffer_t* plaintext, cipher_t* cipher, size_t capacity)
     size_t tag_len = cipher->tag_len;
     int err = CRYPTO_OK;
 
-    static buffer_t tmp = { 0, 0, 0, NULL };
-    brealloc(&tmp, salt_len + tag_len + plaintext->len, capacity);
-    buffer_t* ciphertext = &tmp;
-    ciphertext->len = tag_len + plaintext->len;
+    brealloc(ciphertext, salt_len + tag_len + plaintext->len, capacity);
 
     /* copy salt to first pos */
     memcpy(ciphertext->data, cipher_ctx.salt, salt_len);
@@ -420,27 +532,27 @@ int aead_encrypt_all(buffer_t* plaintext, cipher_t* cipher, size_t capacity)
 
     aead_cipher_ctx_set_key(&cipher_ctx, 1);
 
-    size_t clen = ciphertext->len;
+    size_t clen = tag_len + plaintext->len;
     err = aead_cipher_encrypt(&cipher_ctx,
         (uint8_t*)ciphertext->data + salt_len, &clen,
         (uint8_t*)plaintext->data, plaintext->len,
-        NULL, 0, cipher_ctx.nonce, cipher_ctx.skey);
+        NULL, 0, cipher_ctx.nonce, cipher_ctx.skey, kernel);
 
     aead_ctx_release(&cipher_ctx);
 
     if (err)
         return CRYPTO_ERROR;
 
-    assert(ciphertext->len == clen);
+    assert(tag_len + plaintext->len == clen);
 
-    brealloc(plaintext, salt_len + ciphertext->len, capacity);
-    memcpy(plaintext->data, ciphertext->data, salt_len + ciphertext->len);
-    plaintext->len = salt_len + ciphertext->len;
+    ciphertext->len = salt_len + clen;
 
     return CRYPTO_OK;
 }
 
-int aead_decrypt_all(buffer_t* ciphertext, cipher_t* cipher, size_t capacity)
+AEAD_INLINE int
+aead_decrypt_all_kernel(const buffer_t* ciphertext, buffer_t* plaintext, cipher_t* cipher, size_t capacity,
+    int kernel)
 {
     size_t salt_len = cipher->key_len;
     size_t tag_len = cipher->tag_len;
@@ -453,10 +565,7 @@ int aead_decrypt_all(buffer_t* ciphertext, cipher_t* cipher, size_t capacity)
     cipher_ctx_t cipher_ctx;
     aead_ctx_init(cipher, &cipher_ctx, 0);
 
-    static buffer_t tmp = { 0, 0, 0, NULL };
-    brealloc(&tmp, ciphertext->len, capacity);
-    buffer_t* plaintext = &tmp;
-    plaintext->len = ciphertext->len - salt_len - tag_len;
+    brealloc(plaintext, ciphertext->len, capacity);
 
     /* get salt */
     uint8_t* salt = cipher_ctx.salt;
@@ -464,17 +573,18 @@ int aead_decrypt_all(buffer_t* ciphertext, cipher_t* cipher, size_t capacity)
 
     if (ppbloom_check((void*)salt, salt_len) == 1) {
         LOGE("crypto: AEAD: repeat salt detected");
+        aead_ctx_release(&cipher_ctx);
         return CRYPTO_ERROR;
     }
 
     aead_cipher_ctx_set_key(&cipher_ctx, 0);
 
-    size_t plen = plaintext->len;
+    size_t plen = ciphertext->len - salt_len - tag_len;
     err = aead_cipher_decrypt(&cipher_ctx,
         (uint8_t*)plaintext->data, &plen,
         (uint8_t*)ciphertext->data + salt_len,
         ciphertext->len - salt_len, NULL, 0,
-        cipher_ctx.nonce, cipher_ctx.skey);
+        cipher_ctx.nonce, cipher_ctx.skey, kernel);
 
     aead_ctx_release(&cipher_ctx);
 
@@ -483,16 +593,113 @@ int aead_decrypt_all(buffer_t* ciphertext, cipher_t* cipher, size_t capacity)
 
     ppbloom_add((void*)salt, salt_len);
 
-    brealloc(ciphertext, plaintext->len, capacity);
-    memcpy(ciphertext->data, plaintext->data, plaintext->len);
-    ciphertext->len = plaintext->len;
+    plaintext->len = plen;
 
     return CRYPTO_OK;
 }
 
-static int
+/*
+ * The length block of a frame seals only CHUNK_SIZE_LEN bytes. For the ChaCha20-Poly1305 kernels one
+ * keystream call gives the Poly1305 key (block 0) and the bytes to xor (the start of block 1), and one
+ * Poly1305 call authenticates them: the bytes crypto_aead_chacha20poly1305_ietf_encrypt makes, without
+ * the incremental state it sets up and clears for every call. The AES-GCM kernel encrypts J0 and the
+ * counter block together and hashes the one block with a single reduction. mbed TLS and the libsodium
+ * AES-256-GCM state do not expose GHASH, those kernels seal it like a payload.
+ */
+#define LEN_KEYSTREAM_LEN (64 + CHUNK_SIZE_LEN)
+
+AEAD_INLINE void
+aead_len_keystream(uint8_t* ks, uint8_t* n, uint8_t* k, int kernel)
+{
+#ifdef FS_HAVE_XCHACHA20IETF
+    if (kernel == KERNEL_XCHACHA20POLY1305IETF) {
+        uint8_t subkey[crypto_stream_chacha20_ietf_KEYBYTES];
+        uint8_t nonce[crypto_stream_chacha20_ietf_NONCEBYTES] = { 0 };
+        crypto_core_hchacha20(subkey, n, k, NULL);
+        memcpy(nonce + 4, n + crypto_core_hchacha20_INPUTBYTES, 8);
+        crypto_stream_chacha20_ietf(ks, LEN_KEYSTREAM_LEN, nonce, subkey);
+        sodium_memzero(subkey, sizeof(subkey));
+        return;
+    }
+#endif
+    crypto_stream_chacha20_ietf(ks, LEN_KEYSTREAM_LEN, n, k);
+}
+
+/* over c, its padding to 16 bytes, then the length of the (empty) additional data and of c as 64 bit
+ * little endian */
+AEAD_INLINE void
+aead_len_mac(uint8_t* mac, const uint8_t* c, const uint8_t* ks)
+{
+    uint8_t block[32] = { 0 };
+    memcpy(block, c, CHUNK_SIZE_LEN);
+    block[24] = CHUNK_SIZE_LEN;
+    crypto_onetimeauth_poly1305(mac, block, sizeof(block), ks);
+}
+
+/* seals plen to the CHUNK_SIZE_LEN + tag_len bytes at c */
+AEAD_INLINE int
+aead_len_seal(cipher_ctx_t* ctx, uint8_t* c, uint16_t plen, uint8_t* n, int kernel)
+{
+    uint8_t len_buf[CHUNK_SIZE_LEN];
+    uint16_t t = htons(plen & CHUNK_SIZE_MASK);
+    memcpy(len_buf, &t, CHUNK_SIZE_LEN);
+
+    if (kernel == KERNEL_CHACHA20POLY1305IETF || kernel == KERNEL_XCHACHA20POLY1305IETF) {
+        uint8_t ks[LEN_KEYSTREAM_LEN];
+        aead_len_keystream(ks, n, ctx->skey, kernel);
+        c[0] = len_buf[0] ^ ks[64];
+        c[1] = len_buf[1] ^ ks[65];
+        aead_len_mac(c + CHUNK_SIZE_LEN, c, ks);
+        sodium_memzero(ks, sizeof(ks));
+        return CRYPTO_OK;
+    }
+    if (kernel == KERNEL_AESGCM) {
+        aesgcm_encrypt_short(ctx->aesgcm_ctx, c, c + CHUNK_SIZE_LEN, len_buf, CHUNK_SIZE_LEN, n);
+        return CRYPTO_OK;
+    }
+
+    size_t clen = CHUNK_SIZE_LEN + ctx->cipher->tag_len;
+    if (aead_cipher_encrypt(ctx, c, &clen, len_buf, CHUNK_SIZE_LEN, NULL, 0, n, ctx->skey, kernel))
+        return CRYPTO_ERROR;
+    assert(clen == CHUNK_SIZE_LEN + ctx->cipher->tag_len);
+    return CRYPTO_OK;
+}
+
+/* opens the length block at c, mlen gets the length before CHUNK_SIZE_MASK is applied */
+AEAD_INLINE int
+aead_len_open(cipher_ctx_t* ctx, size_t* mlen, uint8_t* c, uint8_t* n, int kernel)
+{
+    uint8_t len_buf[CHUNK_SIZE_LEN];
+
+    if (kernel == KERNEL_CHACHA20POLY1305IETF || kernel == KERNEL_XCHACHA20POLY1305IETF) {
+        uint8_t ks[LEN_KEYSTREAM_LEN];
+        uint8_t mac[crypto_onetimeauth_poly1305_BYTES];
+        aead_len_keystream(ks, n, ctx->skey, kernel);
+        aead_len_mac(mac, c, ks);
+        int err = crypto_verify_16(mac, c + CHUNK_SIZE_LEN);
+        len_buf[0] = c[0] ^ ks[64];
+        len_buf[1] = c[1] ^ ks[65];
+        sodium_memzero(ks, sizeof(ks));
+        if (err)
+            return CRYPTO_ERROR;
+    } else if (kernel == KERNEL_AESGCM) {
+        if (aesgcm_decrypt_short(ctx->aesgcm_ctx, len_buf, c, CHUNK_SIZE_LEN, c + CHUNK_SIZE_LEN, n))
+            return CRYPTO_ERROR;
+    } else {
+        size_t plen;
+        if (aead_cipher_decrypt(ctx, len_buf, &plen, c, CHUNK_SIZE_LEN + ctx->cipher->tag_len,
+                NULL, 0, n, ctx->skey, kernel))
+            return CRYPTO_ERROR;
+        assert(plen == CHUNK_SIZE_LEN);
+    }
+
+    *mlen = load16_be(len_buf);
+    return CRYPTO_OK;
+}
+
+AEAD_INLINE int
 aead_chunk_encrypt(cipher_ctx_t* ctx, uint8_t* p, uint8_t* c,
-    uint8_t* n, uint16_t plen)
+    uint8_t* n, uint16_t plen, int kernel)
 {
     size_t nlen = ctx->cipher->nonce_len;
     size_t tlen = ctx->cipher->tag_len;
@@ -501,23 +708,16 @@ aead_chunk_encrypt(cipher_ctx_t* ctx, uint8_t* p, uint8_t* c,
 
     int err;
     size_t clen;
-    uint8_t len_buf[CHUNK_SIZE_LEN];
-    uint16_t t = htons(plen & CHUNK_SIZE_MASK);
-    memcpy(len_buf, &t, CHUNK_SIZE_LEN);
 
-    clen = CHUNK_SIZE_LEN + tlen;
-    err = aead_cipher_encrypt(ctx, c, &clen, len_buf, CHUNK_SIZE_LEN,
-        NULL, 0, n, ctx->skey);
+    err = aead_len_seal(ctx, c, plen, n, kernel);
     if (err)
         return CRYPTO_ERROR;
 
-    assert(clen == CHUNK_SIZE_LEN + tlen);
-
     sodium_increment(n, nlen);
 
     clen = plen + tlen;
     err = aead_cipher_encrypt(ctx, c + CHUNK_SIZE_LEN + tlen, &clen, p, plen,
-        NULL, 0, n, ctx->skey);
+        NULL, 0, n, ctx->skey, kernel);
     if (err)
         return CRYPTO_ERROR;
 
@@ -529,18 +729,18 @@ aead_chunk_encrypt(cipher_ctx_t* ctx, uint8_t* p, uint8_t* c,
 }
 
 /* TCP */
-int aead_encrypt(buffer_t* plaintext, cipher_ctx_t* cipher_ctx, size_t capacity)
+AEAD_INLINE int
+aead_encrypt_kernel(const buffer_t* plaintext, buffer_t* ciphertext, cipher_ctx_t* cipher_ctx, size_t capacity,
+    int kernel)
 {
     if (cipher_ctx == NULL)
         return CRYPTO_ERROR;
 
+    ciphertext->len = 0;
     if (plaintext->len == 0) {
         return CRYPTO_OK;
     }
 
-    static buffer_t tmp = { 0, 0, 0, NULL };
-    buffer_t* ciphertext;
-
     cipher_t* cipher = cipher_ctx->cipher;
     int err = CRYPTO_ERROR;
     size_t salt_ofst = 0;
@@ -551,10 +751,10 @@ int aead_encrypt(buffer_t* plaintext, cipher_ctx_t* cipher_ctx, size_t capacity)
         salt_ofst = salt_len;
     }
 
-    size_t out_len = salt_ofst + 2 * tag_len + plaintext->len + CHUNK_SIZE_LEN;
-    brealloc(&tmp, out_len, capacity);
-    ciphertext = &tmp;
-    ciphertext->len = out_len;
+    /* the payload of a chunk is limited to CHUNK_SIZE_MASK, larger input is sealed as several chunks */
+    size_t chunk_num = (plaintext->len + CHUNK_SIZE_MASK - 1) / CHUNK_SIZE_MASK;
+    size_t out_len = salt_ofst + chunk_num * (2 * tag_len + CHUNK_SIZE_LEN) + plaintext->len;
+    brealloc(ciphertext, out_len, capacity);
 
     if (!cipher_ctx->init) {
         memcpy(ciphertext->data, cipher_ctx->salt, salt_len);
@@ -564,23 +764,135 @@ int aead_encrypt(buffer_t* plaintext, cipher_ctx_t* cipher_ctx, size_t capacity)
         ppbloom_add((void*)cipher_ctx->salt, salt_len);
     }
 
-    err = aead_chunk_encrypt(cipher_ctx,
-        (uint8_t*)plaintext->data,
-        (uint8_t*)ciphertext->data + salt_ofst,
-        cipher_ctx->nonce, plaintext->len);
+    size_t pidx = 0;
+    size_t cidx = salt_ofst;
+    while (pidx < plaintext->len) {
+        size_t remain = plaintext->len - pidx;
+        uint16_t plen = remain > CHUNK_SIZE_MASK ? CHUNK_SIZE_MASK : (uint16_t)remain;
+        err = aead_chunk_encrypt(cipher_ctx,
+            (uint8_t*)plaintext->data + pidx,
+            (uint8_t*)ciphertext->data + cidx,
+            cipher_ctx->nonce, plen, kernel);
+        if (err)
+            return err;
+        pidx += plen;
+        cidx += 2 * tag_len + CHUNK_SIZE_LEN + plen;
+    }
+    assert(cidx == out_len);
+
+    ciphertext->len = out_len;
+
+    return CRYPTO_OK;
+}
+
+/* seals the payload at p in place, its encrypted length goes to c and its tag to mac. */
+AEAD_INLINE int
+aead_chunk_encrypt_detached(cipher_ctx_t* ctx, uint8_t* p, uint8_t* c,
+    uint8_t* mac, uint8_t* n, uint16_t plen, int kernel)
+{
+    size_t nlen = ctx->cipher->nonce_len;
+
+    assert(plen <= CHUNK_SIZE_MASK);
+
+    int err;
+
+    err = aead_len_seal(ctx, c, plen, n, kernel);
     if (err)
-        return err;
+        return CRYPTO_ERROR;
 
-    brealloc(plaintext, ciphertext->len, capacity);
-    memcpy(plaintext->data, ciphertext->data, ciphertext->len);
-    plaintext->len = ciphertext->len;
+    sodium_increment(n, nlen);
+
+    err = aead_cipher_encrypt_detached(ctx, p, mac, p, plen, n, ctx->skey, kernel);
+    if (err)
+        return CRYPTO_ERROR;
 
-    return 0;
+    sodium_increment(n, nlen);
+
+    return CRYPTO_OK;
 }
 
-static int
+static buffer_t
+aead_slice(char* data, size_t len)
+{
+    buffer_t slice = { 0, len, len, data };
+    return slice;
+}
+
+/* TCP, scatter/gather: the stream is the same as aead_encrypt makes, but the payload stays where it is.
+ * frame holds the salt, the encrypted lengths and the tags, vec alternates between frame and plaintext:
+ * [salt] len0 | payload0 | tag0 len1 | payload1 | ... | tagN */
+AEAD_INLINE int
+aead_encrypt_vec_kernel(buffer_t* plaintext, buffer_t* frame, buffer_t* vec, size_t* nvec,
+    cipher_ctx_t* cipher_ctx, size_t capacity, int kernel)
+{
+    if (cipher_ctx == NULL)
+        return CRYPTO_ERROR;
+
+    size_t vec_size = *nvec;
+    frame->len = 0;
+    *nvec = 0;
+    if (plaintext->len == 0) {
+        return CRYPTO_OK;
+    }
+
+    cipher_t* cipher = cipher_ctx->cipher;
+    int err = CRYPTO_ERROR;
+    size_t salt_ofst = 0;
+    size_t salt_len = cipher->key_len;
+    size_t tag_len = cipher->tag_len;
+    size_t len_len = CHUNK_SIZE_LEN + tag_len;
+
+    size_t chunk_num = (plaintext->len + CHUNK_SIZE_MASK - 1) / CHUNK_SIZE_MASK;
+    if (2 * chunk_num + 1 > vec_size)
+        return CRYPTO_ERROR;
+
+    if (!cipher_ctx->init) {
+        salt_ofst = salt_len;
+    }
+
+    size_t frame_len = salt_ofst + chunk_num * (len_len + tag_len);
+    brealloc(frame, frame_len, capacity);
+
+    if (!cipher_ctx->init) {
+        memcpy(frame->data, cipher_ctx->salt, salt_len);
+        aead_cipher_ctx_set_key(cipher_ctx, 1);
+        cipher_ctx->init = 1;
+
+        ppbloom_add((void*)cipher_ctx->salt, salt_len);
+    }
+
+    size_t pidx = 0;
+    size_t fidx = salt_ofst;
+    size_t piece = 0; /* start of the frame piece in front of the next payload */
+    size_t n = 0;
+    while (pidx < plaintext->len) {
+        size_t remain = plaintext->len - pidx;
+        uint16_t plen = remain > CHUNK_SIZE_MASK ? CHUNK_SIZE_MASK : (uint16_t)remain;
+        err = aead_chunk_encrypt_detached(cipher_ctx,
+            (uint8_t*)plaintext->data + pidx,
+            (uint8_t*)frame->data + fidx,
+            (uint8_t*)frame->data + fidx + len_len,
+            cipher_ctx->nonce, plen, kernel);
+        if (err)
+            return err;
+        vec[n++] = aead_slice(frame->data + piece, fidx + len_len - piece);
+        vec[n++] = aead_slice(plaintext->data + pidx, plen);
+        piece = fidx + len_len;
+        pidx += plen;
+        fidx += len_len + tag_len;
+    }
+    vec[n++] = aead_slice(frame->data + piece, fidx - piece);
+    assert(fidx == frame_len);
+
+    frame->len = frame_len;
+    *nvec = n;
+
+    return CRYPTO_OK;
+}
+
+AEAD_INLINE int
 aead_chunk_decrypt(cipher_ctx_t* ctx, uint8_t* p, uint8_t* c, uint8_t* n,
-    size_t* plen, size_t* clen)
+    size_t* plen, size_t* clen, int kernel)
 {
     int err;
     size_t mlen;
@@ -590,14 +902,10 @@ aead_chunk_decrypt(cipher_ctx_t* ctx, uint8_t* p, uint8_t* c, uint8_t* n,
     if (*clen <= 2 * tlen + CHUNK_SIZE_LEN)
         return CRYPTO_NEED_MORE;
 
-    uint8_t len_buf[2];
-    err = aead_cipher_decrypt(ctx, len_buf, plen, c, CHUNK_SIZE_LEN + tlen,
-        NULL, 0, n, ctx->skey);
+    err = aead_len_open(ctx, &mlen, c, n, kernel);
     if (err)
         return CRYPTO_ERROR;
-    assert(*plen == CHUNK_SIZE_LEN);
 
-    mlen = load16_be(len_buf);
     mlen = mlen & CHUNK_SIZE_MASK;
 
     if (mlen == 0)
@@ -611,7 +919,7 @@ aead_chunk_decrypt(cipher_ctx_t* ctx, uint8_t* p, uint8_t* c, uint8_t* n,
     sodium_increment(n, nlen);
 
     err = aead_cipher_decrypt(ctx, p, plen, c + CHUNK_SIZE_LEN + tlen, mlen + tlen,
-        NULL, 0, n, ctx->skey);
+        NULL, 0, n, ctx->skey, kernel);
     if (err)
         return CRYPTO_ERROR;
     assert(*plen == mlen);
@@ -623,95 +931,324 @@ aead_chunk_decrypt(cipher_ctx_t* ctx, uint8_t* p, uint8_t* c, uint8_t* n,
     return CRYPTO_OK;
 }
 
-int aead_decrypt(buffer_t* ciphertext, cipher_ctx_t* cipher_ctx, size_t capacity)
+/* the bytes the frame at c still misses, from its length block. 0 once it is complete. */
+AEAD_INLINE int
+aead_chunk_missing(cipher_ctx_t* ctx, uint8_t* c, size_t clen, size_t* missing, int kernel)
 {
-    int err = CRYPTO_OK;
-    static buffer_t tmp = { 0, 0, 0, NULL };
+    size_t tlen = ctx->cipher->tag_len;
+    size_t hlen = CHUNK_SIZE_LEN + tlen;
 
-    cipher_t* cipher = cipher_ctx->cipher;
+    if (clen < hlen) {
+        *missing = hlen - clen;
+        return CRYPTO_OK;
+    }
 
-    size_t salt_len = cipher->key_len;
+    size_t mlen;
+    if (aead_len_open(ctx, &mlen, c, ctx->nonce, kernel))
+        return CRYPTO_ERROR;
+
+    mlen &= CHUNK_SIZE_MASK;
+    if (mlen == 0)
+        return CRYPTO_ERROR;
+
+    size_t chunk_len = 2 * tlen + CHUNK_SIZE_LEN + mlen;
+    *missing = clen < chunk_len ? chunk_len - clen : 0;
+    return CRYPTO_OK;
+}
+
+/* takes the salt from the start of the stream, the session key is set once it is complete */
+static int
+aead_decrypt_salt(cipher_ctx_t* cipher_ctx, const char** in, size_t* in_len, size_t capacity)
+{
+    if (cipher_ctx->init)
+        return CRYPTO_OK;
+
+    size_t salt_len = cipher_ctx->cipher->key_len;
+    size_t take = salt_len;
+    if (cipher_ctx->chunk == NULL && *in_len >= salt_len) {
+        memcpy(cipher_ctx->salt, *in, salt_len);
+    } else {
+        /* the salt comes in pieces */
+        buffer_t* chunk = aead_chunk_acquire(cipher_ctx, capacity);
+        take = min(salt_len - chunk->len, *in_len);
+        memcpy(chunk->data + chunk->len, *in, take);
+        chunk->len += take;
+        if (chunk->len < salt_len)
+            return CRYPTO_NEED_MORE;
+        memcpy(cipher_ctx->salt, chunk->data, salt_len);
+        aead_chunk_release(cipher_ctx);
+    }
+    *in += take;
+    *in_len -= take;
 
-    if (cipher_ctx->chunk == NULL) {
-        cipher_ctx->chunk = (buffer_t*)ss_malloc(sizeof(buffer_t));
-        memset(cipher_ctx->chunk, 0, sizeof(buffer_t));
-        balloc(cipher_ctx->chunk, capacity);
+    if (ppbloom_check((void*)cipher_ctx->salt, salt_len) == 1) {
+        LOGE("crypto: AEAD: repeat salt detected");
+        return CRYPTO_ERROR;
     }
 
-    brealloc(cipher_ctx->chunk,
-        cipher_ctx->chunk->len + ciphertext->len, capacity);
-    memcpy(cipher_ctx->chunk->data + cipher_ctx->chunk->len,
-        ciphertext->data, ciphertext->len);
-    cipher_ctx->chunk->len += ciphertext->len;
+    aead_cipher_ctx_set_key(cipher_ctx, 0);
 
-    brealloc(&tmp, cipher_ctx->chunk->len, capacity);
-    buffer_t* plaintext = &tmp;
+    cipher_ctx->init = 1;
 
-    if (!cipher_ctx->init) {
-        if (cipher_ctx->chunk->len <= salt_len)
+    /* a server sends its salt as soon as it connects */
+    if (*in_len == 0)
+        return CRYPTO_NEED_MORE;
+    return CRYPTO_OK;
+}
+
+/* the frame left incomplete by the last call is completed in place: only its missing bytes are copied
+ * behind it, nothing in the chunk moves. plen is 0 if there was none. */
+AEAD_INLINE int
+aead_decrypt_leftover(cipher_ctx_t* cipher_ctx, const char** in, size_t* in_len, uint8_t* p, size_t* plen,
+    int kernel)
+{
+    buffer_t* chunk = cipher_ctx->chunk;
+    *plen = 0;
+    while (chunk && chunk->len > 0) {
+        size_t missing;
+        if (aead_chunk_missing(cipher_ctx, (uint8_t*)chunk->data, chunk->len, &missing, kernel))
+            return CRYPTO_ERROR;
+        if (missing == 0) {
+            size_t chunk_clen = chunk->len;
+            if (aead_chunk_decrypt(cipher_ctx, p, (uint8_t*)chunk->data,
+                    cipher_ctx->nonce, plen, &chunk_clen, kernel))
+                return CRYPTO_ERROR;
+            chunk->len = 0;
+            break;
+        }
+        size_t take = min(missing, *in_len);
+        memcpy(chunk->data + chunk->len, *in, take);
+        chunk->len += take;
+        *in += take;
+        *in_len -= take;
+        if (take < missing)
             return CRYPTO_NEED_MORE;
+    }
+    return CRYPTO_OK;
+}
 
-        memcpy(cipher_ctx->salt, cipher_ctx->chunk->data, salt_len);
+/* only the start of a frame is left, it waits in the chunk for the rest */
+static void
+aead_chunk_keep(cipher_ctx_t* cipher_ctx, const char* in, size_t in_len, size_t capacity)
+{
+    if (in_len == 0) {
+        aead_chunk_release(cipher_ctx);
+        return;
+    }
+    buffer_t* chunk = aead_chunk_acquire(cipher_ctx, capacity);
+    memcpy(chunk->data, in, in_len);
+    chunk->len = in_len;
+}
 
+/* the salt goes to the bloom filter once the first frame of the stream opened */
+static int
+aead_salt_opened(cipher_ctx_t* cipher_ctx)
+{
+    size_t salt_len = cipher_ctx->cipher->key_len;
+    if (cipher_ctx->init == 1) {
         if (ppbloom_check((void*)cipher_ctx->salt, salt_len) == 1) {
             LOGE("crypto: AEAD: repeat salt detected");
             return CRYPTO_ERROR;
         }
+        ppbloom_add((void*)cipher_ctx->salt, salt_len);
+        cipher_ctx->init = 2;
+    }
+    return CRYPTO_OK;
+}
 
-        aead_cipher_ctx_set_key(cipher_ctx, 0);
+AEAD_INLINE int
+aead_decrypt_kernel(const buffer_t* ciphertext, buffer_t* plaintext, cipher_ctx_t* cipher_ctx, size_t capacity,
+    int kernel)
+{
+    const char* in = ciphertext->data;
+    size_t in_len = ciphertext->len;
 
-        memmove(cipher_ctx->chunk->data, cipher_ctx->chunk->data + salt_len,
-            cipher_ctx->chunk->len - salt_len);
-        cipher_ctx->chunk->len -= salt_len;
+    plaintext->len = 0;
 
-        cipher_ctx->init = 1;
-    }
+    int err = aead_decrypt_salt(cipher_ctx, &in, &in_len, capacity);
+    if (err)
+        return err;
+
+    buffer_t* chunk = cipher_ctx->chunk;
+
+    brealloc(plaintext, (chunk ? chunk->len : 0) + in_len, capacity);
 
     size_t plen = 0;
-    size_t cidx = 0;
-    while (cipher_ctx->chunk->len > 0) {
-        size_t chunk_clen = cipher_ctx->chunk->len;
+    err = aead_decrypt_leftover(cipher_ctx, &in, &in_len, (uint8_t*)plaintext->data, &plen, kernel);
+    if (err)
+        return err;
+
+    /* the complete frames are opened where they are in the input */
+    while (in_len > 0) {
+        size_t chunk_clen = in_len;
         size_t chunk_plen = 0;
         err = aead_chunk_decrypt(cipher_ctx,
             (uint8_t*)plaintext->data + plen,
-            (uint8_t*)cipher_ctx->chunk->data + cidx,
-            cipher_ctx->nonce, &chunk_plen, &chunk_clen);
-        if (err == CRYPTO_ERROR) {
+            (uint8_t*)in,
+            cipher_ctx->nonce, &chunk_plen, &chunk_clen, kernel);
+        if (err == CRYPTO_ERROR)
             return err;
-        } else if (err == CRYPTO_NEED_MORE) {
-            if (plen == 0)
-                return err;
-            else {
-                memmove((uint8_t*)cipher_ctx->chunk->data,
-                    (uint8_t*)cipher_ctx->chunk->data + cidx, chunk_clen);
-                break;
-            }
-        }
-        cipher_ctx->chunk->len = chunk_clen;
-        cidx += cipher_ctx->cipher->tag_len * 2 + CHUNK_SIZE_LEN + chunk_plen;
+        if (err == CRYPTO_NEED_MORE)
+            break;
+        in += in_len - chunk_clen;
+        in_len = chunk_clen;
         plen += chunk_plen;
     }
+
+    aead_chunk_keep(cipher_ctx, in, in_len, capacity);
+
+    if (plen == 0)
+        return CRYPTO_NEED_MORE;
+
     plaintext->len = plen;
 
-    // Add the salt to bloom filter
-    if (cipher_ctx->init == 1) {
-        if (ppbloom_check((void*)cipher_ctx->salt, salt_len) == 1) {
-            LOGE("crypto: AEAD: repeat salt detected");
-            return CRYPTO_ERROR;
+    return aead_salt_opened(cipher_ctx);
+}
+
+/* TCP, scatter/gather: the complete frames are opened in place and their payloads written from there.
+ * only the frame an earlier call left incomplete is opened to plaintext, it comes first in vec. */
+AEAD_INLINE int
+aead_decrypt_vec_kernel(buffer_t* ciphertext, buffer_t* plaintext, buffer_t* vec, size_t* nvec,
+    cipher_ctx_t* cipher_ctx, size_t capacity, int kernel)
+{
+    size_t vec_size = *nvec;
+    size_t tag_len = cipher_ctx->cipher->tag_len;
+
+    plaintext->len = 0;
+    *nvec = 0;
+    if (vec_size < 2)
+        return CRYPTO_ERROR;
+
+    const char* in = ciphertext->data;
+    size_t in_len = ciphertext->len;
+
+    int err = aead_decrypt_salt(cipher_ctx, &in, &in_len, capacity);
+    if (err)
+        return err;
+
+    size_t n = 0;
+    if (cipher_ctx->chunk && cipher_ctx->chunk->len > 0) {
+        size_t plen = 0;
+        brealloc(plaintext, CHUNK_SIZE_MASK, capacity);
+        err = aead_decrypt_leftover(cipher_ctx, &in, &in_len, (uint8_t*)plaintext->data, &plen, kernel);
+        if (err)
+            return err;
+        plaintext->len = plen;
+        vec[n++] = aead_slice(plaintext->data, plen);
+    }
+
+    while (in_len > 0) {
+        uint8_t* payload = (uint8_t*)in + CHUNK_SIZE_LEN + tag_len;
+        size_t chunk_clen = in_len;
+        size_t chunk_plen = 0;
+        err = aead_chunk_decrypt(cipher_ctx, payload, (uint8_t*)in,
+            cipher_ctx->nonce, &chunk_plen, &chunk_clen, kernel);
+        if (err == CRYPTO_ERROR)
+            return err;
+        if (err == CRYPTO_NEED_MORE)
+            break;
+        if (n < vec_size) {
+            vec[n++] = aead_slice((char*)payload, chunk_plen);
+        } else {
+            /* more frames than vec has room for, the payload joins the last piece */
+            buffer_t* last = &vec[n - 1];
+            memmove(last->data + last->len, payload, chunk_plen);
+            last->len += chunk_plen;
+            last->capacity = last->len;
         }
-        ppbloom_add((void*)cipher_ctx->salt, salt_len);
-        cipher_ctx->init = 2;
+        in += in_len - chunk_clen;
+        in_len = chunk_clen;
     }
 
-    brealloc(ciphertext, plaintext->len, capacity);
-    memcpy(ciphertext->data, plaintext->data, plaintext->len);
-    ciphertext->len = plaintext->len;
+    aead_chunk_keep(cipher_ctx, in, in_len, capacity);
 
-    return CRYPTO_OK;
+    if (n == 0)
+        return CRYPTO_NEED_MORE;
+
+    *nvec = n;
+
+    return aead_salt_opened(cipher_ctx);
+}
+
+/* one copy of the entry points per kernel */
+#define AEAD_KERNEL(name, kernel)                                                                            \
+    static int aead_encrypt_all_##name(const buffer_t* plaintext, buffer_t* ciphertext, cipher_t* cipher,   \
+        size_t capacity)                                                                                    \
+    {                                                                                                       \
+        return aead_encrypt_all_kernel(plaintext, ciphertext, cipher, capacity, kernel);                    \
+    }                                                                                                       \
+    static int aead_decrypt_all_##name(const buffer_t* ciphertext, buffer_t* plaintext, cipher_t* cipher,   \
+        size_t capacity)                                                                                    \
+    {                                                                                                       \
+        return aead_decrypt_all_kernel(ciphertext, plaintext, cipher, capacity, kernel);                    \
+    }                                                                                                       \
+    static int aead_encrypt_##name(const buffer_t* plaintext, buffer_t* ciphertext, cipher_ctx_t* cipher_ctx, \
+        size_t capacity)                                                                                    \
+    {                                                                                                       \
+        return aead_encrypt_kernel(plaintext, ciphertext, cipher_ctx, capacity, kernel);                    \
+    }                                                                                                       \
+    static int aead_decrypt_##name(const buffer_t* ciphertext, buffer_t* plaintext, cipher_ctx_t* cipher_ctx, \
+        size_t capacity)                                                                                    \
+    {                                                                                                       \
+        return aead_decrypt_kernel(ciphertext, plaintext, cipher_ctx, capacity, kernel);                    \
+    }                                                                                                       \
+    static int aead_encrypt_vec_##name(buffer_t* plaintext, buffer_t* frame, buffer_t* vec, size_t* nvec,   \
+        cipher_ctx_t* cipher_ctx, size_t capacity)                                                          \
+    {                                                                                                       \
+        return aead_encrypt_vec_kernel(plaintext, frame, vec, nvec, cipher_ctx, capacity, kernel);          \
+    }                                                                                                       \
+    static int aead_decrypt_vec_##name(buffer_t* ciphertext, buffer_t* plaintext, buffer_t* vec, size_t* nvec, \
+        cipher_ctx_t* cipher_ctx, size_t capacity)                                                          \
+    {                                                                                                       \
+        return aead_decrypt_vec_kernel(ciphertext, plaintext, vec, nvec, cipher_ctx, capacity, kernel);     \
+    }                                                                                                       \
+    static const aead_kernel_t aead_kernel_##name = {                                                       \
+        aead_encrypt_all_##name,                                                                            \
+        aead_decrypt_all_##name,                                                                            \
+        aead_encrypt_##name,                                                                                \
+        aead_decrypt_##name,                                                                                \
+        aead_encrypt_vec_##name,                                                                            \
+        aead_decrypt_vec_##name,                                                                            \
+    };
+
+AEAD_KERNEL(gcm, KERNEL_GCM)
+AEAD_KERNEL(aesgcm, KERNEL_AESGCM)
+AEAD_KERNEL(aes256gcm, KERNEL_AES256GCM)
+AEAD_KERNEL(chacha20poly1305ietf, KERNEL_CHACHA20POLY1305IETF)
+#ifdef FS_HAVE_XCHACHA20IETF
+AEAD_KERNEL(xchacha20poly1305ietf, KERNEL_XCHACHA20POLY1305IETF)
+#endif
+
+/* the same choice aead_cipher_ctx_init makes for the contexts of the cipher */
+const aead_kernel_t*
+aead_kernel(const cipher_t* cipher)
+{
+    switch (cipher->method) {
+    case AES256GCM:
+    case AES192GCM:
+    case AES128GCM:
+        switch (aead_gcm_kernel(cipher->method)) {
+        case KERNEL_AES256GCM:
+            return &aead_kernel_aes256gcm;
+        case KERNEL_AESGCM:
+            return &aead_kernel_aesgcm;
+        default:
+            return &aead_kernel_gcm;
+        }
+    case CHACHA20POLY1305IETF:
+        return &aead_kernel_chacha20poly1305ietf;
+#ifdef FS_HAVE_XCHACHA20IETF
+    case XCHACHA20POLY1305IETF:
+        return &aead_kernel_xchacha20poly1305ietf;
+#endif
+    default:
+        return NULL;
+    }
 }
 
 cipher_t*
-aead_key_init(int method, const char* pass, const char* key)
+aead_key_init(
+int method, const char* pass, const char* key)
 {
     if (method < AES128GCM || method >= AEAD_CIPHER_NUM) {
         LOGE("aead_key_init(): Illegal method");
@@ -33,11 +33,18 @@
 #define AEAD_CIPHER_NUM 4
 #endif
 
-int aead_encrypt_all(buffer_t*, cipher_t*, size_t);
-int aead_decrypt_all(buffer_t*, cipher_t*, size_t);
-
-int aead_encrypt(buffer_t*, cipher_ctx_t*, size_t);
-int aead_decrypt(buffer_t*, cipher_ctx_t*, size_t);
+/* the entry points of crypto_t, compiled for one AEAD primitive each */
+typedef struct aead_kernel
+{
+    int (*encrypt_all)(const buffer_t*, buffer_t*, cipher_t*, size_t);
+    int (*decrypt_all)(const buffer_t*, buffer_t*, cipher_t*, size_t);
+    int (*encrypt)(const buffer_t*, buffer_t*, cipher_ctx_t*, size_t);
+    int (*decrypt)(const buffer_t*, buffer_t*, cipher_ctx_t*, size_t);
+    int (*encrypt_vec)(buffer_t*, buffer_t*, buffer_t*, size_t*, cipher_ctx_t*, size_t);
+    int (*decrypt_vec)(buffer_t*, buffer_t*, buffer_t*, size_t*, cipher_ctx_t*, size_t);
+} aead_kernel_t;
+
+const aead_kernel_t* aead_kernel(const cipher_t*);
 
 void aead_ctx_init(cipher_t*, cipher_ctx_t*, int);
 void aead_ctx_release(cipher_ctx_t*);
@@ -0,0 +1,573 @@
+/*
+ * aesgcm.c - AES-GCM on AES-NI and PCLMULQDQ for every AES key size
+ *
+ * The blocks are kept byte reflected for GHASH and multiplied as in Intel's carry-less multiplication
+ * white paper (Gueron, Kounavis), so a run of blocks is multiplied by descending powers of the hash
+ * key and reduced once. The AES-NI path does eight blocks per round, the VAES path sixteen.
+ */
+
+#include "aesgcm.h"
+
+#include <string.h>
+
+#include <sodium.h>
+#include <uv.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define AESGCM_X86
+#endif
+
+#ifdef AESGCM_X86
+
+#include <immintrin.h>
+#include <wmmintrin.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define AESGCM_INLINE static __forceinline
+#define AESGCM_TARGET
+#define AESGCM_TARGET_VAES
+#else
+#define AESGCM_INLINE static inline __attribute__((always_inline))
+#define AESGCM_TARGET __attribute__((target("aes,pclmul,ssse3")))
+#define AESGCM_TARGET_VAES __attribute__((target("aes,pclmul,ssse3,avx2,avx512f,avx512bw,vaes,vpclmulqdq")))
+#endif
+
+#define AESGCM_AESNI 1
+#define AESGCM_VAES 2
+
+/* powers of the hash key, highest first, so a run of n blocks takes the last n */
+#define H_POWERS 16
+
+/* detected once for the process, every event loop seals with the same path */
+static uv_once_t aesgcm_once = UV_ONCE_INIT;
+static int aesgcm_features;
+
+static int
+aesgcm_detect(void)
+{
+    int features = 0;
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    if (!((info[2] >> 25) & 1) || !((info[2] >> 1) & 1))
+        return 0;
+    features |= AESGCM_AESNI;
+    /* the OS must save the AVX-512 state too */
+    if (!((info[2] >> 27) & 1) || (_xgetbv(0) & 0xE6) != 0xE6)
+        return features;
+    __cpuidex(info, 7, 0);
+    if (((info[1] >> 16) & 1) && ((info[1] >> 30) & 1) && ((info[2] >> 9) & 1) && ((info[2] >> 10) & 1))
+        features |= AESGCM_VAES;
+#else
+    __builtin_cpu_init();
+    if (!__builtin_cpu_supports("aes") || !__builtin_cpu_supports("pclmul"))
+        return 0;
+    features |= AESGCM_AESNI;
+    /* these also check that the OS saves the AVX-512 state */
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+        && __builtin_cpu_supports("vaes") && __builtin_cpu_supports("vpclmulqdq"))
+        features |= AESGCM_VAES;
+#endif
+    return features;
+}
+
+static void
+aesgcm_features_init(void)
+{
+    aesgcm_features = aesgcm_detect();
+}
+
+static int
+aesgcm_cpu(void)
+{
+    uv_once(&aesgcm_once, aesgcm_features_init);
+    return aesgcm_features;
+}
+
+#define BSWAP_MASK _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15)
+
+AESGCM_INLINE AESGCM_TARGET void
+clmul_acc(__m128i a, __m128i b, __m128i* lo, __m128i* mid, __m128i* hi)
+{
+    *lo = _mm_xor_si128(*lo, _mm_clmulepi64_si128(a, b, 0x00));
+    *hi = _mm_xor_si128(*hi, _mm_clmulepi64_si128(a, b, 0x11));
+    *mid = _mm_xor_si128(*mid, _mm_clmulepi64_si128(a, b, 0x10));
+    *mid = _mm_xor_si128(*mid, _mm_clmulepi64_si128(a, b, 0x01));
+}
+
+/* the 256 bit sum of products shifted left by one and reduced modulo x^128 + x^7 + x^2 + x + 1 */
+AESGCM_INLINE AESGCM_TARGET __m128i
+ghash_reduce(__m128i lo, __m128i mid, __m128i hi)
+{
+    __m128i t0, t1, t2;
+
+    lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+    hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+    t0 = _mm_srli_epi32(lo, 31);
+    t1 = _mm_srli_epi32(hi, 31);
+    lo = _mm_slli_epi32(lo, 1);
+    hi = _mm_slli_epi32(hi, 1);
+    t2 = _mm_srli_si128(t0, 12);
+    t1 = _mm_slli_si128(t1, 4);
+    t0 = _mm_slli_si128(t0, 4);
+    lo = _mm_or_si128(lo, t0);
+    hi = _mm_or_si128(hi, t1);
+    hi = _mm_or_si128(hi, t2);
+
+    t0 = _mm_slli_epi32(lo, 31);
+    t1 = _mm_slli_epi32(lo, 30);
+    t2 = _mm_slli_epi32(lo, 25);
+    t0 = _mm_xor_si128(t0, t1);
+    t0 = _mm_xor_si128(t0, t2);
+    t1 = _mm_srli_si128(t0, 4);
+    t0 = _mm_slli_si128(t0, 12);
+    lo = _mm_xor_si128(lo, t0);
+
+    t2 = _mm_srli_epi32(lo, 1);
+    t0 = _mm_srli_epi32(lo, 2);
+    t2 = _mm_xor_si128(t2, t0);
+    t0 = _mm_srli_epi32(lo, 7);
+    t2 = _mm_xor_si128(t2, t0);
+    t2 = _mm_xor_si128(t2, t1);
+    lo = _mm_xor_si128(lo, t2);
+    return _mm_xor_si128(hi, lo);
+}
+
+AESGCM_INLINE AESGCM_TARGET __m128i
+gf_mul(__m128i a, __m128i b)
+{
+    __m128i lo = _mm_setzero_si128(), mid = lo, hi = lo;
+    clmul_acc(a, b, &lo, &mid, &hi);
+    return ghash_reduce(lo, mid, hi);
+}
+
+AESGCM_INLINE AESGCM_TARGET __m128i
+aes_block(const __m128i* rk, int rounds, __m128i x)
+{
+    x = _mm_xor_si128(x, rk[0]);
+    for (int r = 1; r < rounds; r++)
+        x = _mm_aesenc_si128(x, rk[r]);
+    return _mm_aesenclast_si128(x, rk[rounds]);
+}
+
+/* hashes a tail shorter than a block as if it were padded with zeros */
+AESGCM_INLINE AESGCM_TARGET __m128i
+ghash_partial(__m128i x, __m128i h, const uint8_t* in, size_t len)
+{
+    uint8_t block[16] = { 0 };
+    memcpy(block, in, len);
+    __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)block), BSWAP_MASK);
+    return gf_mul(_mm_xor_si128(x, b), h);
+}
+
+AESGCM_TARGET static __m128i
+ghash_ad(const aesgcm_ctx* ctx, const uint8_t* ad, size_t adlen)
+{
+    const __m128i bswap = BSWAP_MASK;
+    const __m128i h = _mm_loadu_si128((const __m128i*)ctx->h_powers[H_POWERS - 1]);
+    __m128i x = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= adlen; i += 16) {
+        __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(ad + i)), bswap);
+        x = gf_mul(_mm_xor_si128(x, b), h);
+    }
+    if (i < adlen)
+        x = ghash_partial(x, h, ad + i, adlen - i);
+    return x;
+}
+
+/*
+ * CTR over in, GHASH over the ciphertext, which is the input when opening. ctr is the next counter
+ * block byte reflected. All eight blocks of a round are loaded before any is stored, so out may be in.
+ */
+AESGCM_INLINE AESGCM_TARGET void
+aesgcm_crypt(const aesgcm_ctx* ctx, const __m128i* rk, uint8_t* out, const uint8_t* in, size_t len,
+    __m128i* x, __m128i* ctr, int open)
+{
+    const __m128i bswap = BSWAP_MASK;
+    const __m128i one = _mm_set_epi32(0, 0, 0, 1);
+    const int rounds = ctx->rounds;
+    __m128i hp[8];
+    size_t i = 0;
+
+    for (int j = 0; j < 8; j++)
+        hp[j] = _mm_loadu_si128((const __m128i*)ctx->h_powers[H_POWERS - 8 + j]);
+
+    for (; i + 128 <= len; i += 128) {
+        __m128i k[8], d[8];
+        __m128i lo = _mm_setzero_si128(), mid = lo, hi = lo;
+        for (int j = 0; j < 8; j++) {
+            k[j] = _mm_xor_si128(_mm_shuffle_epi8(*ctr, bswap), rk[0]);
+            *ctr = _mm_add_epi32(*ctr, one);
+        }
+        for (int r = 1; r < rounds; r++) {
+            for (int j = 0; j < 8; j++)
+                k[j] = _mm_aesenc_si128(k[j], rk[r]);
+        }
+        for (int j = 0; j < 8; j++) {
+            k[j] = _mm_aesenclast_si128(k[j], rk[rounds]);
+            d[j] = _mm_loadu_si128((const __m128i*)(in + i + 16 * j));
+        }
+        for (int j = 0; j < 8; j++) {
+            __m128i o = _mm_xor_si128(d[j], k[j]);
+            __m128i b = _mm_shuffle_epi8(open ? d[j] : o, bswap);
+            if (j == 0)
+                b = _mm_xor_si128(b, *x);
+            clmul_acc(b, hp[j], &lo, &mid, &hi);
+            _mm_storeu_si128((__m128i*)(out + i + 16 * j), o);
+        }
+        *x = ghash_reduce(lo, mid, hi);
+    }
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i k = aes_block(rk, rounds, _mm_shuffle_epi8(*ctr, bswap));
+        __m128i d = _mm_loadu_si128((const __m128i*)(in + i));
+        __m128i o = _mm_xor_si128(d, k);
+        *ctr = _mm_add_epi32(*ctr, one);
+        *x = gf_mul(_mm_xor_si128(*x, _mm_shuffle_epi8(open ? d : o, bswap)), hp[7]);
+        _mm_storeu_si128((__m128i*)(out + i), o);
+    }
+
+    if (i < len) {
+        uint8_t block[16] = { 0 };
+        size_t rest = len - i;
+        __m128i k = aes_block(rk, rounds, _mm_shuffle_epi8(*ctr, bswap));
+        *ctr = _mm_add_epi32(*ctr, one);
+        memcpy(block, in + i, rest);
+        if (open)
+            *x = ghash_partial(*x, hp[7], block, rest);
+        _mm_storeu_si128((__m128i*)block, _mm_xor_si128(_mm_loadu_si128((const __m128i*)block), k));
+        memcpy(out + i, block, rest);
+        if (!open)
+            *x = ghash_partial(*x, hp[7], block, rest);
+    }
+}
+
+/* the reflected 128 bit lanes of v summed */
+AESGCM_INLINE AESGCM_TARGET_VAES __m128i
+fold512(__m512i v)
+{
+    __m256i t = _mm256_xor_si256(_mm512_castsi512_si256(v), _mm512_extracti64x4_epi64(v, 1));
+    return _mm_xor_si128(_mm256_castsi256_si128(t), _mm256_extracti128_si256(t, 1));
+}
+
+/* like aesgcm_crypt in runs of sixteen blocks, four per register, returns the bytes done */
+AESGCM_INLINE AESGCM_TARGET_VAES size_t
+aesgcm_crypt_vaes(const aesgcm_ctx* ctx, const __m128i* rk, uint8_t* out, const uint8_t* in, size_t len,
+    __m128i* x, __m128i* ctr, int open)
+{
+    const __m512i bswap = _mm512_broadcast_i32x4(BSWAP_MASK);
+    const __m512i four = _mm512_set_epi32(0, 0, 0, 4, 0, 0, 0, 4, 0, 0, 0, 4, 0, 0, 0, 4);
+    const int rounds = ctx->rounds;
+    __m512i rk512[15], hp[4];
+    size_t i = 0;
+
+    if (len < 256)
+        return 0;
+
+    for (int r = 0; r <= rounds; r++)
+        rk512[r] = _mm512_broadcast_i32x4(rk[r]);
+    for (int g = 0; g < 4; g++)
+        hp[g] = _mm512_loadu_si512((const void*)ctx->h_powers[4 * g]);
+
+    __m512i c = _mm512_add_epi32(_mm512_broadcast_i32x4(*ctr),
+        _mm512_set_epi32(0, 0, 0, 3, 0, 0, 0, 2, 0, 0, 0, 1, 0, 0, 0, 0));
+
+    for (; i + 256 <= len; i += 256) {
+        __m512i k[4], d[4];
+        __m512i lo = _mm512_setzero_si512(), mid = lo, hi = lo;
+        for (int g = 0; g < 4; g++) {
+            k[g] = _mm512_xor_si512(_mm512_shuffle_epi8(c, bswap), rk512[0]);
+            c = _mm512_add_epi32(c, four);
+        }
+        for (int r = 1; r < rounds; r++) {
+            for (int g = 0; g < 4; g++)
+                k[g] = _mm512_aesenc_epi128(k[g], rk512[r]);
+        }
+        for (int g = 0; g < 4; g++) {
+            k[g] = _mm512_aesenclast_epi128(k[g], rk512[rounds]);
+            d[g] = _mm512_loadu_si512((const void*)(in + i + 64 * g));
+        }
+        for (int g = 0; g < 4; g++) {
+            __m512i o = _mm512_xor_si512(d[g], k[g]);
+            __m512i b = _mm512_shuffle_epi8(open ? d[g] : o, bswap);
+            if (g == 0)
+                b = _mm512_xor_si512(b, _mm512_inserti32x4(_mm512_setzero_si512(), *x, 0));
+            lo = _mm512_xor_si512(lo, _mm512_clmulepi64_epi128(b, hp[g], 0x00));
+            hi = _mm512_xor_si512(hi, _mm512_clmulepi64_epi128(b, hp[g], 0x11));
+            mid = _mm512_xor_si512(mid, _mm512_clmulepi64_epi128(b, hp[g], 0x10));
+            mid = _mm512_xor_si512(mid, _mm512_clmulepi64_epi128(b, hp[g], 0x01));
+            _mm512_storeu_si512((void*)(out + i + 64 * g), o);
+        }
+        *x = ghash_reduce(fold512(lo), fold512(mid), fold512(hi));
+    }
+
+    *ctr = _mm512_castsi512_si128(c);
+    return i;
+}
+
+AESGCM_TARGET_VAES static size_t
+aesgcm_seal_vaes(const aesgcm_ctx* ctx, const __m128i* rk, uint8_t* out, const uint8_t* in, size_t len,
+    __m128i* x, __m128i* ctr)
+{
+    return aesgcm_crypt_vaes(ctx, rk, out, in, len, x, ctr, 0);
+}
+
+AESGCM_TARGET_VAES static size_t
+aesgcm_open_vaes(const aesgcm_ctx* ctx, const __m128i* rk, uint8_t* out, const uint8_t* in, size_t len,
+    __m128i* x, __m128i* ctr)
+{
+    return aesgcm_crypt_vaes(ctx, rk, out, in, len, x, ctr, 1);
+}
+
+AESGCM_INLINE AESGCM_TARGET void
+load_round_keys(const aesgcm_ctx* ctx, __m128i* rk)
+{
+    for (int r = 0; r <= ctx->rounds; r++)
+        rk[r] = _mm_loadu_si128((const __m128i*)ctx->round_keys[r]);
+}
+
+/* J0 is the nonce followed by a 32 bit one */
+AESGCM_INLINE AESGCM_TARGET __m128i
+load_j0(const uint8_t* npub)
+{
+    uint8_t block[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 };
+    memcpy(block, npub, AESGCM_NPUBBYTES);
+    return _mm_loadu_si128((const __m128i*)block);
+}
+
+AESGCM_INLINE AESGCM_TARGET __m128i
+aesgcm_tag(const aesgcm_ctx* ctx, const __m128i* rk, __m128i x, size_t adlen, size_t len, __m128i j0)
+{
+    const __m128i h = _mm_loadu_si128((const __m128i*)ctx->h_powers[H_POWERS - 1]);
+    __m128i lengths = _mm_set_epi64x((long long)adlen * 8, (long long)len * 8);
+    x = gf_mul(_mm_xor_si128(x, lengths), h);
+    return _mm_xor_si128(_mm_shuffle_epi8(x, BSWAP_MASK), aes_block(rk, ctx->rounds, j0));
+}
+
+int aesgcm_is_available(void)
+{
+    return (aesgcm_cpu() & AESGCM_AESNI) != 0;
+}
+
+int aesgcm_has_vaes(void)
+{
+    return (aesgcm_cpu() & AESGCM_VAES) != 0;
+}
+
+AESGCM_TARGET int
+aesgcm_beforenm(aesgcm_ctx* ctx, const uint8_t* key, size_t key_len)
+{
+    if (key_len != 16 && key_len != 24 && key_len != 32)
+        return -1;
+
+    /* FIPS 197 key expansion a word at a time, so one loop serves the three key sizes */
+    uint32_t w[60];
+    size_t nk = key_len / 4;
+    size_t words = 4 * (nk + 7);
+    uint32_t rcon = 1;
+    memcpy(w, key, key_len);
+    for (size_t i = nk; i < words; i++) {
+        uint32_t t = w[i - 1];
+        if (i % nk == 0 || (nk > 6 && i % nk == 4)) {
+            /* dword 0 is SubWord of dword 1, dword 1 is RotWord(SubWord) of it */
+            __m128i a = _mm_aeskeygenassist_si128(_mm_set_epi32(0, 0, (int)t, 0), 0);
+            if (i % nk == 0) {
+                t = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(a, 4)) ^ rcon;
+                rcon = (rcon << 1) ^ ((rcon & 0x80) ? 0x11B : 0);
+            } else {
+                t = (uint32_t)_mm_cvtsi128_si32(a);
+            }
+        }
+        w[i] = w[i - nk] ^ t;
+    }
+    memcpy(ctx->round_keys, w, words * 4);
+    sodium_memzero(w, sizeof(w));
+    ctx->rounds = (int)nk + 6;
+
+    __m128i rk[15];
+    load_round_keys(ctx, rk);
+    __m128i h = _mm_shuffle_epi8(aes_block(rk, ctx->rounds, _mm_setzero_si128()), BSWAP_MASK);
+    __m128i power = h;
+    for (int i = H_POWERS - 1; i >= 0; i--) {
+        _mm_storeu_si128((__m128i*)ctx->h_powers[i], power);
+        power = gf_mul(power, h);
+    }
+    return 0;
+}
+
+AESGCM_TARGET void
+aesgcm_encrypt_detached(const aesgcm_ctx* ctx, uint8_t* c, uint8_t* mac,
+    const uint8_t* m, size_t mlen, const uint8_t* ad, size_t adlen, const uint8_t* npub)
+{
+    __m128i rk[15];
+    load_round_keys(ctx, rk);
+    __m128i j0 = load_j0(npub);
+    __m128i ctr = _mm_add_epi32(_mm_shuffle_epi8(j0, BSWAP_MASK), _mm_set_epi32(0, 0, 0, 1));
+    __m128i x = ghash_ad(ctx, ad, adlen);
+
+    size_t done = 0;
+    if (aesgcm_cpu() & AESGCM_VAES)
+        done = aesgcm_seal_vaes(ctx, rk, c, m, mlen, &x, &ctr);
+    aesgcm_crypt(ctx, rk, c + done, m + done, mlen - done, &x, &ctr, 0);
+    _mm_storeu_si128((__m128i*)mac, aesgcm_tag(ctx, rk, x, adlen, mlen, j0));
+}
+
+AESGCM_TARGET int
+aesgcm_decrypt_detached(const aesgcm_ctx* ctx, uint8_t* m, const uint8_t* c, size_t clen,
+    const uint8_t* mac, const uint8_t* ad, size_t adlen, const uint8_t* npub)
+{
+    __m128i rk[15];
+    load_round_keys(ctx, rk);
+    __m128i j0 = load_j0(npub);
+    __m128i ctr = _mm_add_epi32(_mm_shuffle_epi8(j0, BSWAP_MASK), _mm_set_epi32(0, 0, 0, 1));
+    __m128i x = ghash_ad(ctx, ad, adlen);
+
+    size_t done = 0;
+    if (aesgcm_cpu() & AESGCM_VAES)
+        done = aesgcm_open_vaes(ctx, rk, m, c, clen, &x, &ctr);
+    aesgcm_crypt(ctx, rk, m + done, c + done, clen - done, &x, &ctr, 1);
+
+    __m128i tag = aesgcm_tag(ctx, rk, x, adlen, clen, j0);
+    __m128i diff = _mm_xor_si128(tag, _mm_loadu_si128((const __m128i*)mac));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) != 0xFFFF) {
+        sodium_memzero(m, clen);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * A message of at most one block without additional data: its counter block is encrypted together with
+ * J0, and the tag is C * H^2 + lengths * H with a single reduction.
+ */
+AESGCM_INLINE AESGCM_TARGET __m128i
+aesgcm_short(const aesgcm_ctx* ctx, uint8_t* out, const uint8_t* in, size_t len, const uint8_t* npub, int open)
+{
+    const __m128i bswap = BSWAP_MASK;
+    const int rounds = ctx->rounds;
+    __m128i j0 = load_j0(npub);
+    __m128i k0 = _mm_xor_si128(j0, _mm_loadu_si128((const __m128i*)ctx->round_keys[0]));
+    __m128i k1 = _mm_xor_si128(_mm_add_epi8(j0, _mm_set_epi8(1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)),
+        _mm_loadu_si128((const __m128i*)ctx->round_keys[0]));
+    for (int r = 1; r < rounds; r++) {
+        __m128i rk = _mm_loadu_si128((const __m128i*)ctx->round_keys[r]);
+        k0 = _mm_aesenc_si128(k0, rk);
+        k1 = _mm_aesenc_si128(k1, rk);
+    }
+    __m128i rk = _mm_loadu_si128((const __m128i*)ctx->round_keys[rounds]);
+    k0 = _mm_aesenclast_si128(k0, rk);
+    k1 = _mm_aesenclast_si128(k1, rk);
+
+    uint8_t block[16] = { 0 };
+    memcpy(block, in, len);
+    __m128i d = _mm_loadu_si128((const __m128i*)block);
+    __m128i o = _mm_xor_si128(d, k1);
+    _mm_storeu_si128((__m128i*)block, o);
+    memcpy(out, block, len);
+
+    /* the keystream past len is not part of the ciphertext */
+    memset(block, 0, sizeof(block));
+    memcpy(block, open ? in : out, len);
+    __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)block), bswap);
+    __m128i lengths = _mm_set_epi64x(0, (long long)len * 8);
+    __m128i lo = _mm_setzero_si128(), mid = lo, hi = lo;
+    clmul_acc(b, _mm_loadu_si128((const __m128i*)ctx->h_powers[H_POWERS - 2]), &lo, &mid, &hi);
+    clmul_acc(lengths, _mm_loadu_si128((const __m128i*)ctx->h_powers[H_POWERS - 1]), &lo, &mid, &hi);
+    return _mm_xor_si128(_mm_shuffle_epi8(ghash_reduce(lo, mid, hi), bswap), k0);
+}
+
+AESGCM_TARGET void
+aesgcm_encrypt_short(const aesgcm_ctx* ctx, uint8_t* c, uint8_t* mac, const uint8_t* m, size_t mlen,
+    const uint8_t* npub)
+{
+    _mm_storeu_si128((__m128i*)mac, aesgcm_short(ctx, c, m, mlen, npub, 0));
+}
+
+AESGCM_TARGET int
+aesgcm_decrypt_short(const aesgcm_ctx* ctx, uint8_t* m, const uint8_t* c, size_t clen, const uint8_t* mac,
+    const uint8_t* npub)
+{
+    uint8_t p[16];
+    __m128i tag = aesgcm_short(ctx, p, c, clen, npub, 1);
+    __m128i diff = _mm_xor_si128(tag, _mm_loadu_si128((const __m128i*)mac));
+    int ok = _mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) == 0xFFFF;
+    if (ok)
+        memcpy(m, p, clen);
+    sodium_memzero(p, sizeof(p));
+    return ok ? 0 : -1;
+}
+
+#else
+
+int aesgcm_is_available(void)
+{
+    return 0;
+}
+
+int aesgcm_has_vaes(void)
+{
+    return 0;
+}
+
+int aesgcm_beforenm(aesgcm_ctx* ctx, const uint8_t* key, size_t key_len)
+{
+    (void)ctx;
+    (void)key;
+    (void)key_len;
+    return -1;
+}
+
+void aesgcm_encrypt_detached(const aesgcm_ctx* ctx, uint8_t* c, uint8_t* mac,
+    const uint8_t* m, size_t mlen, const uint8_t* ad, size_t adlen, const uint8_t* npub)
+{
+    (void)ctx;
+    (void)c;
+    (void)mac;
+    (void)m;
+    (void)mlen;
+    (void)ad;
+    (void)adlen;
+    (void)npub;
+}
+
+int aesgcm_decrypt_detached(const aesgcm_ctx* ctx, uint8_t* m, const uint8_t* c, size_t clen,
+    const uint8_t* mac, const uint8_t* ad, size_t adlen, const uint8_t* npub)
+{
+    (void)ctx;
+    (void)m;
+    (void)c;
+    (void)clen;
+    (void)mac;
+    (void)ad;
+    (void)adlen;
+    (void)npub;
+    return -1;
+}
+
+void aesgcm_encrypt_short(const aesgcm_ctx* ctx, uint8_t* c, uint8_t* mac, const uint8_t* m, size_t mlen,
+    const uint8_t* npub)
+{
+    (void)ctx;
+    (void)c;
+    (void)mac;
+    (void)m;
+    (void)mlen;
+    (void)npub;
+}
+
+int aesgcm_decrypt_short(const aesgcm_ctx* ctx, uint8_t* m, const uint8_t* c, size_t clen, const uint8_t* mac,
+    const uint8_t* npub)
+{
+    (void)ctx;
+    (void)m;
+    (void)c;
+    (void)clen;
+    (void)mac;
+    (void)npub;
+    return -1;
+}
+
+#endif
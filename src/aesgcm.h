@@ -0,0 +1,51 @@
+/*
+ * aesgcm.h - AES-GCM on AES-NI and PCLMULQDQ for every AES key size
+ *
+ * libsodium only does AES-256-GCM in hardware and mbed TLS runs GCM one block at a time. This seals
+ * and opens a whole message with the blocks interleaved, on VAES and VPCLMULQDQ four blocks per
+ * instruction when the CPU and the OS allow AVX-512. The nonce is 12 bytes and the tag 16 bytes.
+ */
+
+#ifndef _AESGCM_H
+#define _AESGCM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define AESGCM_NPUBBYTES 12
+#define AESGCM_ABYTES 16
+
+/* the expanded key and the powers of the hash key, built once per key by aesgcm_beforenm() */
+typedef struct aesgcm_ctx
+{
+    uint8_t round_keys[15][16];
+    uint8_t h_powers[16][16];
+    int rounds;
+} aesgcm_ctx;
+
+/* 1 if the CPU has AES-NI and PCLMULQDQ, the functions below must not be called otherwise */
+int aesgcm_is_available(void);
+
+/* 1 if runs of blocks go through VAES and VPCLMULQDQ, only then does AES-256 beat libsodium */
+int aesgcm_has_vaes(void);
+
+/* key_len is 16, 24 or 32, returns -1 for other lengths */
+int aesgcm_beforenm(aesgcm_ctx* ctx, const uint8_t* key, size_t key_len);
+
+/* c may be m */
+void aesgcm_encrypt_detached(const aesgcm_ctx* ctx, uint8_t* c, uint8_t* mac,
+    const uint8_t* m, size_t mlen, const uint8_t* ad, size_t adlen, const uint8_t* npub);
+
+/* m may be c, returns -1 and clears m if the tag does not match */
+int aesgcm_decrypt_detached(const aesgcm_ctx* ctx, uint8_t* m, const uint8_t* c, size_t clen,
+    const uint8_t* mac, const uint8_t* ad, size_t adlen, const uint8_t* npub);
+
+/* the same for at most 16 bytes and no additional data, as the length block of a frame */
+void aesgcm_encrypt_short(const aesgcm_ctx* ctx, uint8_t* c, uint8_t* mac, const uint8_t* m, size_t mlen,
+    const uint8_t* npub);
+
+/* m may be c, returns -1 and leaves m alone if the tag does not match */
+int aesgcm_decrypt_short(const aesgcm_ctx* ctx, uint8_t* m, const uint8_t* c, size_t clen, const uint8_t* mac,
+    const uint8_t* npub);
+
+#endif // _AESGCM_H
@@ -32,6 +32,7 @@
 #endif
 
 #include <mbedtls/md5.h>
+#include <mbedtls/sha1.h>
 #include <mbedtls/version.h>
 #include <sodium.h>
 #include <stdint.h>
@@ -51,6 +52,19 @@
 #define VLA_FREE(NAME) free(NAME)
 #endif
 #define max(a, b) (((a) > (b)) ? (a) : (b))
+
+#if MBEDTLS_VERSION_NUMBER >= 0x02070000
+#define SHA1_STARTS(ctx) mbedtls_sha1_starts_ret(ctx)
+#define SHA1_UPDATE(ctx, input, len) mbedtls_sha1_update_ret(ctx, input, len)
+#define SHA1_FINISH(ctx, output) mbedtls_sha1_finish_ret(ctx, output)
+#else
+#define SHA1_STARTS(ctx) mbedtls_sha1_starts(ctx)
+#define SHA1_UPDATE(ctx, input, len) mbedtls_sha1_update(ctx, input, len)
+#define SHA1_FINISH(ctx, output) mbedtls_sha1_finish(ctx, output)
+#endif
+#define SHA1_SIZE 20
+#define SHA1_BLOCK_SIZE 64
+
 int balloc(buffer_t* ptr, size_t capacity)
 {
     sodium_memzero(ptr, sizeof(buffer_t));
@@ -186,13 +200,17 @@ crypto_init(const char* password, const char* key, const char* method)
             cipher_t* cipher = aead_init(password, key, method);
             if (cipher == NULL)
                 return NULL;
+            /* picked once here, the calls through crypto_t do not look at the method again */
+            const aead_kernel_t* kernel = aead_kernel(cipher);
             crypto_t* crypto = (crypto_t*)ss_malloc(sizeof(crypto_t));
             crypto_t tmp = {
                 .cipher = cipher,
-                .encrypt_all = &aead_encrypt_all,
-                .decrypt_all = &aead_decrypt_all,
-                .encrypt = &aead_encrypt,
-                .decrypt = &aead_decrypt,
+                .encrypt_all = kernel->encrypt_all,
+                .decrypt_all = kernel->decrypt_all,
+                .encrypt = kernel->encrypt,
+                .decrypt = kernel->decrypt,
+                .encrypt_vec = kernel->encrypt_vec,
+                .decrypt_vec = kernel->decrypt_vec,
                 .ctx_init = &aead_ctx_init,
                 .ctx_release = &aead_ctx_release,
             };
@@ -346,6 +364,139 @@ int crypto_hkdf_expand(const mbedtls_md_info_t* md, const unsigned char* prk,
     return 0;
 }
 
+/* HMAC-SHA1 with the key blocks hashed once, every MAC starts from copies of these states */
+typedef struct
+{
+    mbedtls_sha1_context inner;
+    mbedtls_sha1_context outer;
+} hmac_sha1_t;
+
+static void
+hmac_sha1_setkey(hmac_sha1_t* hmac, const unsigned char* key, size_t key_len)
+{
+    unsigned char pad[SHA1_BLOCK_SIZE];
+    unsigned char sum[SHA1_SIZE];
+    size_t i;
+
+    if (key_len > SHA1_BLOCK_SIZE) {
+        mbedtls_sha1_context ctx;
+        mbedtls_sha1_init(&ctx);
+        SHA1_STARTS(&ctx);
+        SHA1_UPDATE(&ctx, key, key_len);
+        SHA1_FINISH(&ctx, sum);
+        mbedtls_sha1_free(&ctx);
+        key = sum;
+        key_len = SHA1_SIZE;
+    }
+
+    memset(pad, 0x36, SHA1_BLOCK_SIZE);
+    for (i = 0; i < key_len; i++)
+        pad[i] ^= key[i];
+    mbedtls_sha1_init(&hmac->inner);
+    SHA1_STARTS(&hmac->inner);
+    SHA1_UPDATE(&hmac->inner, pad, SHA1_BLOCK_SIZE);
+
+    for (i = 0; i < SHA1_BLOCK_SIZE; i++)
+        pad[i] ^= 0x36 ^ 0x5C;
+    mbedtls_sha1_init(&hmac->outer);
+    SHA1_STARTS(&hmac->outer);
+    SHA1_UPDATE(&hmac->outer, pad, SHA1_BLOCK_SIZE);
+
+    sodium_memzero(pad, sizeof(pad));
+    sodium_memzero(sum, sizeof(sum));
+}
+
+static void
+hmac_sha1_free(hmac_sha1_t* hmac)
+{
+    mbedtls_sha1_free(&hmac->inner);
+    mbedtls_sha1_free(&hmac->outer);
+}
+
+static void
+hmac_sha1_starts(const hmac_sha1_t* hmac, mbedtls_sha1_context* inner)
+{
+    mbedtls_sha1_init(inner);
+    mbedtls_sha1_clone(inner, &hmac->inner);
+}
+
+/* inner came from hmac_sha1_starts and has taken the message */
+static void
+hmac_sha1_finish(const hmac_sha1_t* hmac, mbedtls_sha1_context* inner, unsigned char* mac)
+{
+    unsigned char sum[SHA1_SIZE];
+    mbedtls_sha1_context outer;
+
+    SHA1_FINISH(inner, sum);
+    mbedtls_sha1_free(inner);
+    mbedtls_sha1_init(&outer);
+    mbedtls_sha1_clone(&outer, &hmac->outer);
+    SHA1_UPDATE(&outer, sum, SHA1_SIZE);
+    SHA1_FINISH(&outer, mac);
+    mbedtls_sha1_free(&outer);
+}
+
+/*
+ * crypto_hkdf with SHA1, on stack contexts: there is no digest lookup and no allocation, and the key
+ * blocks of PRK are hashed once for every block of OKM.
+ */
+int crypto_hkdf_sha1(const unsigned char* salt, int salt_len,
+    const unsigned char* ikm, int ikm_len,
+    const unsigned char* info, int info_len,
+    unsigned char* okm, int okm_len)
+{
+    hmac_sha1_t hmac;
+    mbedtls_sha1_context inner;
+    unsigned char prk[SHA1_SIZE];
+    unsigned char T[SHA1_SIZE];
+    unsigned char c;
+    int where;
+
+    if (salt_len < 0 || ikm_len < 0 || info_len < 0 || okm_len < 0 || okm == NULL) {
+        return CRYPTO_ERROR;
+    }
+
+    if (okm_len > 255 * SHA1_SIZE) {
+        return CRYPTO_ERROR;
+    }
+
+    /* the HMAC key is padded with zeros, no salt is the same as a zero salt */
+    if (salt == NULL) {
+        salt_len = 0;
+    }
+
+    if (info == NULL) {
+        info = (const unsigned char*)"";
+    }
+
+    /* HKDF-Extract(salt, IKM) -> PRK */
+    hmac_sha1_setkey(&hmac, salt, salt_len);
+    hmac_sha1_starts(&hmac, &inner);
+    SHA1_UPDATE(&inner, ikm, ikm_len);
+    hmac_sha1_finish(&hmac, &inner, prk);
+    hmac_sha1_free(&hmac);
+
+    /* HKDF-Expand(PRK, info, L) -> OKM */
+    hmac_sha1_setkey(&hmac, prk, SHA1_SIZE);
+    for (c = 1, where = 0; where < okm_len; c++) {
+        int n = okm_len - where < SHA1_SIZE ? okm_len - where : SHA1_SIZE;
+        hmac_sha1_starts(&hmac, &inner);
+        if (c > 1) {
+            SHA1_UPDATE(&inner, T, SHA1_SIZE);
+        }
+        SHA1_UPDATE(&inner, info, info_len);
+        SHA1_UPDATE(&inner, &c, 1);
+        hmac_sha1_finish(&hmac, &inner, T);
+        memcpy(okm + where, T, n);
+        where += n;
+    }
+    hmac_sha1_free(&hmac);
+
+    sodium_memzero(prk, sizeof(prk));
+    sodium_memzero(T, sizeof(T));
+    return 0;
+}
+
 int crypto_parse_key(const char* base64, uint8_t* key, size_t key_len)
 {
     size_t base64_len = strlen(base64);
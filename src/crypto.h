@@ -36,6 +36,7 @@
 /* Definitions for libsodium */
 #include <sodium.h>
 typedef crypto_aead_aes256gcm_state aes256gcm_ctx;
+#include "aesgcm.h"
 /* Definitions for mbedTLS */
 #include <mbedtls/cipher.h>
 #include <mbedtls/md.h>
@@ -106,21 +107,39 @@ typedef struct
     uint64_t counter;
     cipher_evp_t* evp;
     aes256gcm_ctx* aes256gcm_ctx;
+    aesgcm_ctx* aesgcm_ctx;
     cipher_t* cipher;
     buffer_t* chunk;
     uint8_t salt[MAX_KEY_LENGTH];
     uint8_t skey[MAX_KEY_LENGTH];
     uint8_t nonce[MAX_NONCE_LENGTH];
+    /* evp, aes256gcm_ctx or aesgcm_ctx and chunk point in here, so a context brings its own storage */
+    union
+    {
+        crypto_aead_aes256gcm_state aes256gcm;
+        struct aesgcm_ctx aesgcm;
+        cipher_evp_t evp;
+    } state;
+    buffer_t chunk_buf;
 } cipher_ctx_t;
 
 typedef struct crypto
 {
     cipher_t* cipher;
 
-    int (*const encrypt_all)(buffer_t*, cipher_t*, size_t);
-    int (*const decrypt_all)(buffer_t*, cipher_t*, size_t);
-    int (*const encrypt)(buffer_t*, cipher_ctx_t*, size_t);
-    int (*const decrypt)(buffer_t*, cipher_ctx_t*, size_t);
+    /* (input, output, ...): the result is written to output, which must not alias input */
+    int (*const encrypt_all)(const buffer_t*, buffer_t*, cipher_t*, size_t);
+    int (*const decrypt_all)(const buffer_t*, buffer_t*, cipher_t*, size_t);
+    int (*const encrypt)(const buffer_t*, buffer_t*, cipher_ctx_t*, size_t);
+    int (*const decrypt)(const buffer_t*, buffer_t*, cipher_ctx_t*, size_t);
+    /* (input, frame, vec, nvec, ...): input is encrypted in place and the rest of the stream format goes to
+     * frame. vec receives the pieces in stream order, nvec holds the size of vec and returns the count.
+     * NULL for ciphers that cannot do it. */
+    int (*const encrypt_vec)(buffer_t*, buffer_t*, buffer_t*, size_t*, cipher_ctx_t*, size_t);
+    /* (input, plaintext, vec, nvec, ...): the complete frames of input are opened in place, a frame that
+     * started in an earlier input is opened to plaintext. vec receives the plaintext pieces in stream order,
+     * nvec holds the size of vec (at least 2) and returns the count. NULL for ciphers that cannot do it. */
+    int (*const decrypt_vec)(buffer_t*, buffer_t*, buffer_t*, size_t*, cipher_ctx_t*, size_t);
 
     void (*const ctx_init)(cipher_t*, cipher_ctx_t*, int);
     void (*const ctx_release)(cipher_ctx_t*);
@@ -130,6 +149,11 @@ int balloc(buffer_t*, size_t);
 int brealloc(buffer_t*, size_t, size_t);
 int bprepend(buffer_t*, buffer_t*, size_t);
 void bfree(buffer_t*);
+/* blocks from the BufferPool of the calling thread, for buffers that are only held while data is in flight */
+/* the pool also keeps blocks of this size, an AEAD frame of the largest payload with its length block and tags */
+#define BPOOL_CHUNK_CAPACITY (2 * 16 + 2 + 0x3FFF)
+char* bpool_acquire(size_t);
+void bpool_recycle(char*, size_t);
 int rand_bytes(void*, int);
 
 crypto_t* crypto_init(const char*, const char*, const char*);
@@ -147,6 +171,10 @@ int crypto_hkdf_extract(const mbedtls_md_info_t* md, const unsigned char* salt,
 int crypto_hkdf_expand(const mbedtls_md_info_t* md, const unsigned char* prk,
     int prk_len, const unsigned char* info, int info_len,
     unsigned char* okm, int okm_len);
+int crypto_hkdf_sha1(const unsigned char* salt, int salt_len,
+    const unsigned char* ikm, int ikm_len,
+    const unsigned char* info, int info_len,
+    unsigned char* okm, int okm_len);
 #ifdef SS_DEBUG
 void dump(char* tag, char* text, int len);
 #endif
@@ -7,9 +7,13 @@
 #include "uvw/timer.h"
 #include "uvw/util.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <memory>
-#include <unordered_map>
+#include <thread>
 #include <utility>
+#include <vector>
 #if defined(_WIN32)
 #include <WS2tcpip.h>
 #else
@@ -18,8 +22,12 @@
 #include "Buffer.hpp"
 #include "CipherEnv.hpp"
 #include "ConnectionContext.hpp"
+#include "DNSResolver.hpp"
 #include "NetUtils.hpp"
+#include "RemotePool.hpp"
+#include "Slab.hpp"
 #include "TCPRelay.hpp"
+#include "TimerWheel.hpp"
 #include "UDPRelay.hpp"
 #include "shadowsocks.h"
 #ifdef SSR_UVW_WITH_QT
@@ -31,39 +39,80 @@ class TCPRelayImpl : public virtual TCPRelay
 {
 private:
     static constexpr int SVERSION = 0x05;
+    // declared before the loop, handles give their read buffers back until the loop is gone.
+    std::unique_ptr<ReadBufferPool> readBufferPool;
     std::shared_ptr<uvw::Loop> loop;
     std::shared_ptr<uvw::TimerHandle> stopTimer;
+    // connect and idle timeouts of every connection of the loop, driven by one timer.
+    std::unique_ptr<TimerWheel> connectionTimeouts;
+    std::shared_ptr<uvw::TimerHandle> connectionTimer;
+    std::atomic<uint64_t> connectTimeouts { 0 }, idleTimeouts { 0 };
+    std::atomic<uint64_t> fastOpenAccepted { 0 }, fastOpenFallbacks { 0 };
+    std::unique_ptr<RemotePool> remotePool;
+    std::atomic<uint64_t> poolHits { 0 }, poolMisses { 0 }, poolSavedMs { 0 };
+    // write queue sizes at which a connection stops and resumes reading from the other side.
+    static constexpr size_t WRITE_HIGH_WATERMARK = 1024 * 1024;
+    static constexpr size_t WRITE_LOW_WATERMARK = 256 * 1024;
+    std::atomic<uint64_t> backpressurePauses { 0 }, peakQueuedBytes { 0 };
+    std::atomic<uint64_t> peakBufferBytes { 0 }, peakBufferConnections { 0 };
+    uint64_t lastBufferSample = 0; // loop time of the last sampleBufferMemory
+    static constexpr int MAX_CONNECT_TIMEOUT_MS = 10000;
+    static constexpr uint64_t TIMEOUT_TICK_MS = 1000;
     std::shared_ptr<uvw::ProcessHandle> pluginProcess;
     uint16_t pluginPort = 0;
+    // the plugin only talks to this process, it listens on loopback whatever profile_t::local_addr is.
+    static constexpr const char* PLUGIN_HOST = "127.0.0.1";
 #ifdef SSR_UVW_WITH_QT
     std::shared_ptr<uvw::TimerHandle> statisticsUpdateTimer;
 #endif
     std::shared_ptr<uvw::TCPHandle> tcpServer;
     std::unique_ptr<UDPRelay> udpRelay;
-    bool isStop = false;
+    std::atomic<bool> isStop { false };
     bool verbose = false;
     profile_t profile {};
     bool acl = false;
     socks5_address address {};
     std::unique_ptr<CipherEnv> cipherEnv;
-    uint64_t tx = 0, rx = 0;
+    std::atomic<uint64_t> tx { 0 }, rx { 0 };
     uint64_t last_tx = 0, last_rx = 0;
     sockaddr_storage remoteAddr {};
-    std::unordered_map<std::shared_ptr<uvw::TCPHandle>, std::shared_ptr<ConnectionContext>> inComingConnections;
+    // address of the other family for happy eyeballs, ss_family is 0 when the server has one family only.
+    sockaddr_storage remoteAltAddr {};
+    int preferredFamily = 0; // the family of the last connect that won the race
+    static constexpr int CONNECTION_ATTEMPT_DELAY_MS = 250;
+    // follows address changes of profile.remote_host without blocking the loop.
+    std::unique_ptr<DNSResolver> resolver;
+    std::shared_ptr<uvw::TimerHandle> dnsRefreshTimer;
+    // the listeners of a connection's handles refer to its context directly, none of them looks it up.
+    Slab<ConnectionContext> inComingConnections;
     double last {};
+    // worker pool: every worker owns a loop, a listener bound with SO_REUSEPORT and its own cipher env.
+    const TCPRelayImpl* parent = nullptr;
+    std::vector<std::unique_ptr<TCPRelayImpl>> workers;
+    std::vector<std::thread> workerThreads;
 
 private:
     void stat_update_cb()
     {
 #ifdef SSR_UVW_WITH_QT
-        auto diff_tx = tx - last_tx;
-        auto diff_rx = rx - last_rx;
+        uint64_t total_tx = tx, total_rx = rx;
+        for (auto& worker : workers) {
+            total_tx += worker->tx;
+            total_rx += worker->rx;
+        }
+        auto diff_tx = total_tx - last_tx;
+        auto diff_rx = total_rx - last_rx;
         send_traffic_stat(diff_tx, diff_rx);
-        last_tx = tx;
-        last_rx = rx;
+        last_tx = total_tx;
+        last_rx = total_rx;
 #endif
     }
 
+    bool stopping() const
+    {
+        return isStop || (parent && parent->isStop);
+    }
+
 public:
     TCPRelayImpl() = default;
     static TCPRelayImpl& getDefaultInstance()
@@ -87,6 +136,37 @@ public:
         isStop = true;
     }
 
+    Stats stats() const override
+    {
+        Stats stats;
+        stats.connectTimeouts = connectTimeouts;
+        stats.idleTimeouts = idleTimeouts;
+        stats.fastOpenAccepted = fastOpenAccepted;
+        stats.fastOpenFallbacks = fastOpenFallbacks;
+        stats.poolHits = poolHits;
+        stats.poolMisses = poolMisses;
+        stats.poolSavedMs = poolSavedMs;
+        stats.backpressurePauses = backpressurePauses;
+        stats.peakQueuedBytes = peakQueuedBytes;
+        stats.peakBufferBytes = peakBufferBytes;
+        stats.peakBufferConnections = peakBufferConnections;
+        for (auto& worker : workers) {
+            stats.connectTimeouts += worker->connectTimeouts;
+            stats.idleTimeouts += worker->idleTimeouts;
+            stats.fastOpenAccepted += worker->fastOpenAccepted;
+            stats.fastOpenFallbacks += worker->fastOpenFallbacks;
+            stats.poolHits += worker->poolHits;
+            stats.poolMisses += worker->poolMisses;
+            stats.poolSavedMs += worker->poolSavedMs;
+            stats.backpressurePauses += worker->backpressurePauses;
+            stats.peakQueuedBytes = std::max<uint64_t>(stats.peakQueuedBytes, worker->peakQueuedBytes);
+            // the peaks of the loops need not be at the same time, their sum is an upper bound.
+            stats.peakBufferBytes += worker->peakBufferBytes;
+            stats.peakBufferConnections += worker->peakBufferConnections;
+        }
+        return stats;
+    }
+
 private:
     uint16_t getLocalPort()
     {
@@ -104,7 +184,7 @@ private:
         struct sockaddr_in serv_addr;
         memset(&serv_addr, 0, sizeof(serv_addr));
         serv_addr.sin_family = AF_INET;
-        serv_addr.sin_addr.s_addr = INADDR_ANY;
+        serv_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
         serv_addr.sin_port = 0;
         tmpTCP->bind(reinterpret_cast<const struct sockaddr&>(serv_addr));
         return tmpTCP->sock().port;
@@ -133,7 +213,7 @@ private:
         ss_remote_host += profile.remote_host;
         sprintf(digitBuffer, "%d", profile.remote_port);
         ss_remote_port += digitBuffer;
-        ss_local_host += profile.local_addr;
+        ss_local_host += PLUGIN_HOST;
         memset(digitBuffer, 0, sizeof(digitBuffer));
         pluginPort = getLocalPort();
         sprintf(digitBuffer, "%d", pluginPort);
@@ -166,12 +246,12 @@ private:
         pluginProcess->spawn(profile.plugin, args, env.data());
     }
 
-    void handShakeReceive(const uvw::DataEvent& event, uvw::TCPHandle& client)
+    void handShakeReceive(ConnectionContext& ctx, const uvw::DataEvent& event, uvw::TCPHandle& client)
     {
         if (event.data[0] == 0x05 && event.length > 1) {
             auto dataWrite = std::unique_ptr<char[]>(new char[2] { SVERSION, 0 });
             client.write(std::move(dataWrite), 2);
-            client.once<uvw::DataEvent>([this](auto& e, auto& h) { handShakeSendCallBack(e, h); });
+            client.once<uvw::DataEvent>([this, &ctx](auto& e, auto& h) { handShakeSendCallBack(ctx, e, h); });
             return;
         } else if (event.length > 1) {
             auto dataWrite = std::unique_ptr<char[]>(new char[2] { SVERSION, 0 });
@@ -180,25 +260,23 @@ private:
         client.close();
     }
 
-    void readAllAddress(uvw::DataEvent& event, uvw::TCPHandle& client)
+    void readAllAddress(ConnectionContext& connectionContext, uvw::DataEvent& event, uvw::TCPHandle& client)
     {
-        ConnectionContext& connectionContext = *inComingConnections[client.shared_from_this()];
-        Buffer& buf = *connectionContext.localBuf;
+        Buffer& buf = connectionContext.localBuf;
         buf.copy(event);
         if (socks5_address_parse((uint8_t*)buf.begin() + 3, buf.length() - 3, &address)) {
             buf.drop(3);
             connectionContext.construct_cipher(*cipherEnv);
-            startConnect(client);
+            startConnect(connectionContext);
         } else {
-            client.once<uvw::DataEvent>([this](auto& e, auto& h) { readAllAddress(e, h); });
+            client.once<uvw::DataEvent>([this, &connectionContext](auto& e, auto& h) { readAllAddress(connectionContext, e, h); });
         }
     }
 
-    void handShakeSendCallBack(uvw::DataEvent& event, uvw::TCPHandle& client)
+    void handShakeSendCallBack(ConnectionContext& connectionContext, uvw::DataEvent& event, uvw::TCPHandle& client)
     {
         int cmd;
-        ConnectionContext& connectionContext = *inComingConnections[client.shared_from_this()];
-        Buffer& buf = *connectionContext.localBuf;
+        Buffer& buf = connectionContext.localBuf;
         if (buf.length() + event.length >= 5) {
             // VER 	CMD 	RSV 	ATYP 	DST.ADDR 	DST.PORT
             // 1 	1 	    0x00 	1 	      动态 	     2
@@ -219,9 +297,9 @@ private:
                 if (buf.length() != 0 && socks5_address_parse((uint8_t*)buf.begin() + 3, buf.length() - 3, &address)) {
                     buf.drop(3);
                     connectionContext.construct_cipher(*cipherEnv);
-                    startConnect(client);
+                    startConnect(connectionContext);
                 } else {
-                    client.once<uvw::DataEvent>([this](auto& e, auto& h) { readAllAddress(e, h); });
+                    client.once<uvw::DataEvent>([this, &connectionContext](auto& e, auto& h) { readAllAddress(connectionContext, e, h); });
                     return;
                 }
                 break;
@@ -236,7 +314,7 @@ private:
         } else {
             // shall we just close it?
             buf.copy(event);
-            client.once<uvw::DataEvent>([this](auto& e, auto& h) { handShakeSendCallBack(e, h); });
+            client.once<uvw::DataEvent>([this, &connectionContext](auto& e, auto& h) { handShakeSendCallBack(connectionContext, e, h); });
         }
     }
 
@@ -255,35 +333,186 @@ private:
         client.write(std::move(response), response_length);
     }
 
-    void panic(const std::shared_ptr<uvw::TCPHandle>& clientConnection)
+    // destroys ctx, which closes its handles.
+    void panic(ConnectionContext& ctx)
     {
         if (verbose)
             LOGI("panic close client connection");
-        if (inComingConnections.find(clientConnection) != inComingConnections.end()) {
-            inComingConnections.erase(clientConnection);
+        if (verbose && ctx.peakQueued > WRITE_HIGH_WATERMARK)
+            LOGI("the connection had up to %zu bytes waiting to be written", ctx.peakQueued);
+        inComingConnections.erase(ctx.slabId);
+    }
+
+    // a write may fail right away, its error handler has then destroyed the connection.
+    bool alive(Slab<ConnectionContext>::Id id)
+    {
+        return inComingConnections.find(id) != nullptr;
+    }
+
+    // the bytes sink has left to write and the read slabs and blocks its vectored writes hold on to.
+    static size_t queuedBytes(ConnectionContext& ctx, uvw::TCPHandle& sink)
+    {
+        return sink.writeQueueSize() + (&sink == ctx.client.get() ? ctx.clientRetained : ctx.remoteRetained);
+    }
+
+    // after a write to sink: stops reading from source while sink has more than WRITE_HIGH_WATERMARK queued.
+    void throttle(ConnectionContext& ctx, uvw::TCPHandle& sink, uvw::TCPHandle& source, bool& paused)
+    {
+        size_t queued = queuedBytes(ctx, sink);
+        if (queued > ctx.peakQueued) {
+            ctx.peakQueued = queued;
+            if (queued > peakQueuedBytes)
+                peakQueuedBytes = queued;
+        }
+        if (paused || queued <= WRITE_HIGH_WATERMARK)
+            return;
+        paused = true;
+        ++backpressurePauses;
+        source.stop();
+    }
+
+    // on every write completion of sink, reading from source resumes once it drained to WRITE_LOW_WATERMARK.
+    static void drain(ConnectionContext& ctx, uvw::TCPHandle& sink, uvw::TCPHandle& source, bool& paused)
+    {
+        if (!paused || queuedBytes(ctx, sink) > WRITE_LOW_WATERMARK || source.closing())
+            return;
+        paused = false;
+        source.read();
+    }
+
+    // owns the memory of a vectored write: the read its payload is in and the pool block with the rest.
+    // What they hold beyond the written bytes is retained by the connection until the write is done, the
+    // write event comes before that, so the drain is checked again here.
+    class VecWrite
+    {
+    public:
+        VecWrite(TCPRelayImpl& relay, ConnectionContext& ctx, bool toClient, BufferPool::Storage block,
+            uvw::ReadBuffer read, size_t extra)
+            : relay { &relay }
+            , id { ctx.slabId }
+            , toClient { toClient }
+            , extra { extra }
+            , block { std::move(block) }
+            , read { std::move(read) }
+        {
+            (toClient ? ctx.clientRetained : ctx.remoteRetained) += extra;
+        }
+
+        VecWrite(VecWrite&& other) noexcept
+            : relay { std::exchange(other.relay, nullptr) }
+            , id { other.id }
+            , toClient { other.toClient }
+            , extra { other.extra }
+            , block { std::move(other.block) }
+            , read { std::move(other.read) }
+        {
+        }
+
+        VecWrite(const VecWrite&) = delete;
+        VecWrite& operator=(const VecWrite&) = delete;
+        VecWrite& operator=(VecWrite&&) = delete;
+
+        ~VecWrite()
+        {
+            if (!relay)
+                return;
+            // a connection that is gone took its counts with it.
+            auto ctx = relay->inComingConnections.find(id);
+            if (!ctx)
+                return;
+            block.reset();
+            read.reset();
+            if (toClient) {
+                ctx->clientRetained -= extra;
+                drain(*ctx, *ctx->client, *ctx->remote, ctx->remotePaused);
+            } else {
+                ctx->remoteRetained -= extra;
+                drain(*ctx, *ctx->remote, *ctx->client, ctx->clientPaused);
+            }
+        }
+
+    private:
+        TCPRelayImpl* relay;
+        Slab<ConnectionContext>::Id id;
+        bool toClient;
+        size_t extra;
+        BufferPool::Storage block;
+        uvw::ReadBuffer read;
+    };
+
+    // writes bufs to the client or the remote of ctx, they point into block and read.
+    void writeVec(ConnectionContext& ctx, bool toClient, BufferPool::Storage block, uvw::ReadBuffer read,
+        const uv_buf_t* bufs, unsigned int nbufs)
+    {
+        size_t held = readBufferPool->slabSize() + block.get_deleter().capacity;
+        size_t written = 0;
+        for (unsigned int i = 0; i < nbufs; ++i)
+            written += bufs[i].len;
+        auto& sink = toClient ? *ctx.client : *ctx.remote;
+        sink.write(VecWrite { *this, ctx, toClient, std::move(block), std::move(read), held > written ? held - written : 0 },
+            bufs, nbufs);
+    }
+
+    // a non-positive profile_t::timeout disables both timeouts.
+    void touchConnection(ConnectionContext& ctx)
+    {
+        if (profile.timeout <= 0)
+            return;
+        int timeout = ctx.established ? profile.timeout : std::min(profile.timeout, MAX_CONNECT_TIMEOUT_MS);
+        connectionTimeouts->schedule(ctx, timeout, loop->now().count());
+        if (!connectionTimer->active()) {
+            auto tick = uvw::TimerHandle::Time { connectionTimeouts->tickMs() };
+            connectionTimer->start(tick, tick);
         }
     }
-    void sockStream(uvw::DataEvent& event, uvw::TCPHandle& client)
+
+    void expireConnection(TimerWheel::Entry& entry)
+    {
+        auto& ctx = static_cast<ConnectionContext&>(entry);
+        if (ctx.established)
+            ++idleTimeouts;
+        else
+            ++connectTimeouts;
+        if (verbose)
+            LOGI("%s timeout, close connection", ctx.established ? "idle" : "connect");
+        panic(ctx);
+    }
+    void sockStream(ConnectionContext& connectionContext, uvw::DataEvent& event, uvw::TCPHandle& client)
     {
         if (client.closing())
             return;
-        auto clientPtr = client.shared_from_this();
-        if (inComingConnections.find(clientPtr) == inComingConnections.end()) {
+        auto id = connectionContext.slabId;
+        Buffer& buf = connectionContext.remoteBuf;
+        tx += event.length;
+        touchConnection(connectionContext);
+        if (connectionContext.coalesceTimer) {
+            connectionContext.localBuf.copy(event);
+            sendTarget(connectionContext);
             return;
         }
-        auto connectionContextPtr = inComingConnections[clientPtr];
-        auto& connectionContext = *connectionContextPtr;
-        Buffer& buf = *connectionContext.remoteBuf;
-        buf.copy(event);
-        tx += buf.length();
-        int err = buf.ssEncrypt(*cipherEnv, connectionContext);
+        if (cipherEnv->crypto->encrypt_vec) {
+            // the payload is sealed where it was read and written from there, only the framing is new.
+            uv_buf_t bufs[Buffer::MAX_VEC_BUFS];
+            unsigned int nbufs = 0;
+            if (buf.ssEncryptVec(*cipherEnv, connectionContext, event.data.get(), event.length, bufs, nbufs)) {
+                panic(connectionContext);
+                return;
+            }
+            writeVec(connectionContext, false, buf.release(), std::move(event.data), bufs, nbufs);
+            if (alive(id))
+                throttle(connectionContext, *connectionContext.remote, client, connectionContext.clientPaused);
+            return;
+        }
+        int err = buf.ssEncrypt(*cipherEnv, connectionContext, event.data.get(), event.length);
         if (err) {
-            panic(clientPtr);
+            panic(connectionContext);
             return;
         }
         if (buf.length() != 0) {
-            connectionContext.remote->write(buf.duplicateDataToArray(), buf.length());
-            buf.clear();
+            auto len = buf.length();
+            connectionContext.remote->write(buf.release(), len);
+            if (alive(id))
+                throttle(connectionContext, *connectionContext.remote, client, connectionContext.clientPaused);
             return;
         }
     }
@@ -293,114 +522,288 @@ private:
             return;
         }
         rx += event.length;
-        auto& buf = *ctx.localBuf;
-        char* base = event.data.get();
-        char* guard = base + event.length;
-        for (auto iter = base; iter < guard; iter += Buffer::BUF_DEFAULT_CAPACITY) {
-            buf.bufRealloc(Buffer::BUF_DEFAULT_CAPACITY);
-            size_t remain = guard - iter;
-            size_t len = remain > Buffer::BUF_DEFAULT_CAPACITY ? Buffer::BUF_DEFAULT_CAPACITY : remain;
-            buf.copyFromBegin(iter, len);
-            int err = buf.ssDecrypt(*cipherEnv, ctx);
+        touchConnection(ctx);
+        if (ctx.fastOpen) {
+            // the handshake is done once the server answers.
+            ctx.fastOpen = false;
+            if (ssr_fast_open_accepted(remote.fileno()) == 1)
+                ++fastOpenAccepted;
+            else
+                ++fastOpenFallbacks;
+        }
+        auto& buf = ctx.localBuf;
+        if (cipherEnv->crypto->decrypt_vec) {
+            // the frames are opened where they were read and written from there, only a frame that
+            // started in an earlier read is opened to buf.
+            uv_buf_t bufs[Buffer::MAX_VEC_BUFS];
+            unsigned int nbufs = 0;
+            int err = buf.ssDecryptVec(*cipherEnv, ctx, event.data.get(), event.length, bufs, nbufs);
             if (err == CRYPTO_ERROR) {
-                panic(ctx.client);
+                panic(ctx);
                 return;
             } else if (err == CRYPTO_NEED_MORE) {
-                buf.clear();
-                continue;
+                return;
             }
-            ctx.client->write(buf.duplicateDataToArray(), buf.length());
+            auto id = ctx.slabId;
+            writeVec(ctx, true, buf.release(), std::move(event.data), bufs, nbufs);
+            if (alive(id))
+                throttle(ctx, *ctx.client, remote, ctx.remotePaused);
+            return;
+        }
+        int err = buf.ssDecrypt(*cipherEnv, ctx, event.data.get(), event.length);
+        if (err == CRYPTO_ERROR) {
+            panic(ctx);
+            return;
+        } else if (err == CRYPTO_NEED_MORE) {
             buf.clear();
+            return;
         }
+        auto len = buf.length();
+        auto id = ctx.slabId;
+        ctx.client->write(buf.release(), len);
+        if (alive(id))
+            throttle(ctx, *ctx.client, remote, ctx.remotePaused);
     }
 
-    void connectRemote(ConnectionContext& ctx)
+    static void closeAttempt(std::shared_ptr<uvw::TCPHandle>& remote)
     {
-        auto remote = ctx.remote;
-        if (!remote)
-            return;
-        remote->connect(reinterpret_cast<const sockaddr&>(remoteAddr));
-        remote->on<uvw::DataEvent>([&ctx, this](uvw::DataEvent& event, uvw::TCPHandle& remoteHandle) { remoteRecv(ctx, event, remoteHandle); });
-        remote->once<uvw::ConnectEvent>([&ctx, this](const uvw::ConnectEvent&, uvw::TCPHandle& h) {
-            h.read();
-            ctx.client->write(std::unique_ptr<char[]>(new char[10] { 5, 0, 0, 1, 0, 0, 0, 0, 0, 0 }), 10);
-            ctx.remoteBuf = std::make_unique<Buffer>();
-            ctx.remoteBuf->copy(*ctx.localBuf);
-            ctx.localBuf->clear();
-            int err = ctx.remoteBuf->ssEncrypt(*cipherEnv, ctx);
+        remote->clear();
+        remote->close();
+        remote.reset();
+    }
+
+    // slot is set before connecting, a connect that fails right away already sees its handle in place.
+    void connectAttempt(ConnectionContext& ctx, const sockaddr_storage& addr, std::shared_ptr<uvw::TCPHandle>& slot)
+    {
+        // the fast open socket connects at once, it would win every happy eyeballs race.
+        bool fastOpen = profile.fast_open && remoteAltAddr.ss_family == 0;
+        auto remoteTcp = fastOpen ? loop->resource<uvw::TCPHandle>(addr.ss_family) : loop->resource<uvw::TCPHandle>();
+        if (fastOpen) {
+            int err = ssr_set_fast_open_connect(remoteTcp->fileno());
             if (err) {
-                panic(ctx.client);
-                return;
+                LOGI("TCP fast open is not available (%s), connect normally", uv_strerror(err));
+                profile.fast_open = 0;
+                ++fastOpenFallbacks;
+                fastOpen = false;
             }
-            ctx.remote->once<uvw::WriteEvent>([&ctx, this](auto&, auto&) {
-                ctx.client->on<uvw::DataEvent>([this](uvw::DataEvent& event, uvw::TCPHandle& client) {
-                    // when this event traiggered, we are in stream mode.
-                    sockStream(event, client);
-                });
-                ctx.remoteBuf->clear();
-            });
-            ctx.remote->write(ctx.remoteBuf->begin(), ctx.remoteBuf->length());
-            // stop remote send and start local recv
+        }
+        ctx.fastOpen = fastOpen;
+        slot = remoteTcp;
+        watchRemote(ctx, *remoteTcp);
+        remoteTcp->once<uvw::ConnectEvent>([&ctx, this, family = addr.ss_family](const uvw::ConnectEvent&, uvw::TCPHandle& h) {
+            remoteConnected(ctx, h, family);
         });
+        remoteTcp->connect(reinterpret_cast<const sockaddr&>(addr));
     }
-    void startConnect(uvw::TCPHandle& client)
+
+    void watchRemote(ConnectionContext& ctx, uvw::TCPHandle& remoteTcp)
     {
-        auto clientPtr = client.shared_from_this();
-        auto& connectionContext = *inComingConnections[clientPtr];
-        if (acl) {
-            // todo acl
-        }
-        auto remoteTcp = loop->resource<uvw::TCPHandle>();
-        connectionContext.setRemoteTcpHandle(remoteTcp);
-        // todo timer
-        remoteTcp->once<uvw::ErrorEvent>([clientPtr, this](const uvw::ErrorEvent& e, uvw::TCPHandle&) {
+        remoteTcp.once<uvw::ErrorEvent>([&ctx, this](const uvw::ErrorEvent& e, uvw::TCPHandle& h) {
+            if (!ctx.established && attemptFailed(ctx, h))
+                return;
             LOGE("remote error %s", e.what());
-            panic(clientPtr);
+            panic(ctx);
         });
-        remoteTcp->once<uvw::CloseEvent>([clientPtr, this](const uvw::CloseEvent&, uvw::TCPHandle&) {
+        remoteTcp.once<uvw::CloseEvent>([&ctx, this](const uvw::CloseEvent&, uvw::TCPHandle&) {
             if (verbose)
                 LOGI("remote close");
-            panic(clientPtr);
+            panic(ctx);
         });
-        remoteTcp->once<uvw::EndEvent>([clientPtr, this](const uvw::EndEvent&, uvw::TCPHandle&) {
+        remoteTcp.once<uvw::EndEvent>([&ctx, this](const uvw::EndEvent&, uvw::TCPHandle&) {
             if (verbose)
                 LOGI("remote end event");
-            panic(clientPtr);
+            panic(ctx);
+        });
+        remoteTcp.noDelay(true);
+        remoteTcp.on<uvw::DataEvent>([&ctx, this](uvw::DataEvent& event, uvw::TCPHandle& remoteHandle) { remoteRecv(ctx, event, remoteHandle); });
+    }
+
+    // returns false when no attempt is left, the connection has failed.
+    bool attemptFailed(ConnectionContext& ctx, uvw::TCPHandle& h)
+    {
+        if (ctx.fallbackRemote.get() == &h) {
+            closeAttempt(ctx.fallbackRemote);
+            return true;
+        }
+        if (ctx.remote.get() != &h)
+            return false;
+        if (ctx.fallbackRemote) {
+            closeAttempt(ctx.remote);
+            ctx.remote = std::move(ctx.fallbackRemote);
+            return true;
+        }
+        if (ctx.fallbackTimer) {
+            // the first family failed before the attempt delay, try the other one right now.
+            ctx.fallbackTimer->stop();
+            ctx.fallbackTimer->close();
+            ctx.fallbackTimer.reset();
+            closeAttempt(ctx.remote);
+            connectAttempt(ctx, ctx.fallbackAddr, ctx.remote);
+            return true;
+        }
+        return false;
+    }
+
+    void remoteConnected(ConnectionContext& ctx, uvw::TCPHandle& h, int family)
+    {
+        if (ctx.fallbackRemote.get() == &h) {
+            closeAttempt(ctx.remote);
+            ctx.remote = std::move(ctx.fallbackRemote);
+        } else if (ctx.fallbackRemote) {
+            closeAttempt(ctx.fallbackRemote);
+        }
+        if (ctx.fallbackTimer) {
+            ctx.fallbackTimer->stop();
+            ctx.fallbackTimer->close();
+            ctx.fallbackTimer.reset();
+        }
+        // the next connections start with the family that won.
+        if (remoteAltAddr.ss_family != 0)
+            preferredFamily = family;
+        ctx.established = true;
+        touchConnection(ctx);
+        ctx.client->on<uvw::DataEvent>([this, &ctx](uvw::DataEvent& event, uvw::TCPHandle& client) {
+            // when this event traiggered, we are in stream mode.
+            sockStream(ctx, event, client);
         });
-        remoteTcp->noDelay(true);
-        // fastopen is not implemented due to fastopen is still WIP
-        // https://github.com/libuv/libuv/pull/1136
-        connectRemote(connectionContext);
+        ctx.remote->on<uvw::WriteEvent>([&ctx](auto&, uvw::TCPHandle& h) { drain(ctx, h, *ctx.client, ctx.clientPaused); });
+        ctx.client->on<uvw::WriteEvent>([&ctx](auto&, uvw::TCPHandle& h) { drain(ctx, h, *ctx.remote, ctx.remotePaused); });
+        auto id = ctx.slabId;
+        ctx.client->write(std::unique_ptr<char[]>(new char[10] { 5, 0, 0, 1, 0, 0, 0, 0, 0, 0 }), 10);
+        if (!alive(id))
+            return;
+        // the client only sends its first data (e.g. a TLS ClientHello) after the reply above. the target
+        // address waits for it a little, so both are sealed into one chunk and leave in one segment.
+        if (profile.coalesce_window <= 0 || ctx.localBuf.length() > socks5AddressLength(ctx.localBuf)) {
+            sendTarget(ctx);
+            return;
+        }
+        ctx.coalesceTimer = loop->resource<uvw::TimerHandle>();
+        ctx.coalesceTimer->once<uvw::TimerEvent>([&ctx, this](auto&, auto&) { sendTarget(ctx); });
+        // the loop time is from the start of this iteration, the window would end early.
+        loop->update();
+        ctx.coalesceTimer->start(uvw::TimerHandle::Time { profile.coalesce_window }, uvw::TimerHandle::Time { 0 });
+    }
+
+    // encrypts what localBuf holds, the target address and the client data that came with it, as the
+    // first chunk to the server. ctx is gone when the encryption fails. the remote is only read from
+    // here on, remoteRecv decrypts into localBuf and would drop the address still waiting in it.
+    void sendTarget(ConnectionContext& ctx)
+    {
+        if (ctx.coalesceTimer) {
+            ctx.coalesceTimer->stop();
+            ctx.coalesceTimer->close();
+            ctx.coalesceTimer.reset();
+        }
+        auto& buf = ctx.remoteBuf;
+        int err = buf.ssEncrypt(*cipherEnv, ctx, ctx.localBuf.begin(), ctx.localBuf.length());
+        ctx.localBuf.clear();
+        if (err) {
+            panic(ctx);
+            return;
+        }
+        auto len = buf.length();
+        auto id = ctx.slabId;
+        ctx.remote->write(buf.release(), len);
+        if (!alive(id))
+            return;
+        ctx.remote->read();
+        throttle(ctx, *ctx.remote, *ctx.client, ctx.clientPaused);
+    }
+
+    // length of the socks5 address at the start of buf, which is complete after readAllAddress.
+    static size_t socks5AddressLength(Buffer& buf)
+    {
+        switch (buf[0]) {
+        case SOCKS5_ADDRTYPE_IPV4:
+            return 1 + 4 + 2;
+        case SOCKS5_ADDRTYPE_IPV6:
+            return 1 + 16 + 2;
+        default:
+            return 1 + 1 + static_cast<uint8_t>(buf[1]) + 2;
+        }
+    }
+
+    // happy eyeballs (RFC 8305) when the server has addresses of both families: the second family
+    // is raced against the first one after CONNECTION_ATTEMPT_DELAY_MS, or as soon as the first fails.
+    void startConnect(ConnectionContext& connectionContext)
+    {
+        if (acl) {
+            // todo acl
+        }
+        const sockaddr_storage* first = &remoteAddr;
+        const sockaddr_storage* second = remoteAltAddr.ss_family != 0 ? &remoteAltAddr : nullptr;
+        if (second && second->ss_family == preferredFamily)
+            std::swap(first, second);
+        if (remotePool) {
+            auto pooled = remotePool->take();
+            remotePool->fill(*first);
+            if (pooled.handle) {
+                ++poolHits;
+                poolSavedMs += pooled.connectMs;
+                connectionContext.remote = pooled.handle;
+                watchRemote(connectionContext, *pooled.handle);
+                remoteConnected(connectionContext, *pooled.handle, first->ss_family);
+                return;
+            }
+            ++poolMisses;
+        }
+        auto id = connectionContext.slabId;
+        connectAttempt(connectionContext, *first, connectionContext.remote);
+        // the attempt may have failed and panicked already.
+        if (!second || !alive(id))
+            return;
+        connectionContext.fallbackAddr = *second;
+        connectionContext.fallbackTimer = loop->resource<uvw::TimerHandle>();
+        connectionContext.fallbackTimer->once<uvw::TimerEvent>([&ctx = connectionContext, this](auto&, auto& h) {
+            h.close();
+            ctx.fallbackTimer.reset();
+            connectAttempt(ctx, ctx.fallbackAddr, ctx.fallbackRemote);
+        });
+        connectionContext.fallbackTimer->start(uvw::TimerHandle::Time { CONNECTION_ATTEMPT_DELAY_MS }, uvw::TimerHandle::Time { 0 });
         // we send socks5 fake response after we real connected remote server;
     }
 
     int listen()
     {
-        tcpServer = loop->resource<uvw::TCPHandle>();
+        sockaddr_storage localStorage {};
+        if (ssr_get_sock_addr(loop, profile.local_addr, profile.local_port, &localStorage, 0) == -1) {
+            LOGE("local socks server can't bind to %s:%d", profile.local_addr, profile.local_port);
+            return -1;
+        }
+        // create the socket up front, SO_REUSEPORT must be set before bind.
+        tcpServer = loop->resource<uvw::TCPHandle>(localStorage.ss_family);
+        if (profile.workers > 1) {
+            int err = ssr_set_reuse_port(tcpServer->fileno());
+            if (err) {
+                LOGE("SO_REUSEPORT is not available (%s), use a single event loop", uv_strerror(err));
+                profile.workers = 1;
+            }
+        }
+        tcpServer->on<uvw::ErrorEvent>([](const uvw::ErrorEvent& e, uvw::TCPHandle&) {
+            LOGE("local server error %s", e.what());
+        });
         tcpServer->noDelay(true);
         tcpServer->on<uvw::ListenEvent>([this](const uvw::ListenEvent&, uvw::TCPHandle& srv) {
             std::shared_ptr<uvw::TCPHandle> client = srv.loop().resource<uvw::TCPHandle>();
-            inComingConnections.emplace(std::make_pair(client, std::make_shared<ConnectionContext>(client, cipherEnv.get())));
-            client->once<uvw::CloseEvent>([this](const uvw::CloseEvent&, uvw::TCPHandle& c) {
-                auto clientPtr = c.shared_from_this();
+            auto id = inComingConnections.emplace(client, cipherEnv.get());
+            auto& ctx = *inComingConnections.find(id);
+            ctx.slabId = id;
+            // the connect timeout covers the socks5 handshake as well.
+            touchConnection(ctx);
+            client->once<uvw::CloseEvent>([this, &ctx](const uvw::CloseEvent&, uvw::TCPHandle&) {
                 if (verbose)
                     LOGI("client close");
-                panic(clientPtr);
+                panic(ctx);
             });
-            client->once<uvw::ErrorEvent>([this](const uvw::ErrorEvent& e, uvw::TCPHandle& c) {
-                auto clientPtr = c.shared_from_this();
+            client->once<uvw::ErrorEvent>([this, &ctx](const uvw::ErrorEvent& e, uvw::TCPHandle&) {
                 LOGE("client error %s", e.what());
-                panic(clientPtr);
+                panic(ctx);
             });
-            client->once<uvw::DataEvent>([this](const uvw::DataEvent& event, uvw::TCPHandle& client) { handShakeReceive(event, client); });
+            client->once<uvw::DataEvent>([this, &ctx](const uvw::DataEvent& event, uvw::TCPHandle& client) { handShakeReceive(ctx, event, client); });
             srv.accept(*client);
             client->read();
         });
-        sockaddr_storage localStorage {};
-        if (ssr_get_sock_addr(loop, profile.local_addr, profile.local_port, &localStorage, 0) == -1) {
-            LOGE("local socks server can't bind to %s:%d", profile.local_addr, profile.local_port);
-            return -1;
-        }
         tcpServer->bind(reinterpret_cast<const struct sockaddr&>(localStorage));
         tcpServer->listen();
         return 0;
@@ -413,11 +816,15 @@ public:
         profile = p;
         isStop = false;
         tx = rx = last_rx = last_tx = 0;
-        loop = uvw::Loop::create();
+        connectTimeouts = idleTimeouts = 0;
+        fastOpenAccepted = fastOpenFallbacks = 0;
+        poolHits = poolMisses = poolSavedMs = 0;
+        backpressurePauses = peakQueuedBytes = 0;
+        peakBufferBytes = peakBufferConnections = 0;
+        createLoop();
 #ifndef _WIN32
         signal(SIGPIPE, SIG_IGN);
 #endif
-        stopTimer = loop->resource<uvw::TimerHandle>();
         LOGI("listening at %s:%d", profile.local_addr, profile.local_port);
         cipherEnv = std::make_unique<CipherEnv>(profile.password, profile.method, profile.key);
         if (cipherEnv->crypto)
@@ -434,43 +841,7 @@ public:
         });
         statisticsUpdateTimer->start(uvw::TimerHandle::Time { 1000 }, uvw::TimerHandle::Time { 1000 });
 #endif
-        stopTimer->on<uvw::TimerEvent>([this, ssr_work_mode = p.mode](auto&, auto& handle) {
-            if (isStop) {
-                if (!tcpServer->closing()) {
-#ifdef SSR_UVW_WITH_QT
-                    statisticsUpdateTimer->stop();
-                    statisticsUpdateTimer->close();
-#endif
-                    tcpServer->close();
-                    inComingConnections.clear();
-                    if (ssr_work_mode == 1) {
-                        udpRelay.reset(nullptr);
-                    }
-                    if (pluginProcess) {
-                        pluginProcess->kill(SIGTERM);
-                    }
-                }
-                int timer_count = 0;
-                uv_walk(
-                    loop->raw(),
-                    [](uv_handle_t* handle, void* arg) {
-                        int& counter = *static_cast<int*>(arg);
-                        if (uv_is_closing(handle) == 0)
-                            counter++;
-                    },
-                    &timer_count);
-                //only current timer
-                if (timer_count != 1)
-                    return;
-                handle.stop();
-                handle.close();
-                loop->clear();
-                loop->close();
-                cipherEnv.reset(nullptr);
-                loop->stop();
-            }
-        });
-        stopTimer->start(uvw::TimerHandle::Time { 500 }, uvw::TimerHandle::Time { 500 });
+        startStopTimer();
         if (profile.plugin) {
             startPlugin();
             if (pluginProcess && pluginProcess->closing())
@@ -479,10 +850,10 @@ public:
                 return -1;
         }
         if (ssr_get_sock_addr(loop,
-                pluginPort ? profile.local_addr : profile.remote_host,
+                pluginPort ? PLUGIN_HOST : profile.remote_host,
                 pluginPort ? pluginPort : profile.remote_port,
                 reinterpret_cast<struct sockaddr_storage*>(&remoteAddr),
-                p.ipv6first)
+                p.ipv6first, &remoteAltAddr)
             == -1)
             return -1;
         int res = 0;
@@ -505,9 +876,255 @@ public:
         res = listen();
         if (res)
             return res;
+        startRemoteRefresh();
+        startRemotePool();
+        startWorkers();
         loop->run();
+        joinWorkers();
+        logReadBufferStats();
+        logConnectionStats();
         return 0;
     }
+
+private:
+    void createLoop()
+    {
+        loop = uvw::Loop::create();
+        readBufferPool = std::make_unique<ReadBufferPool>();
+        loop->readBufferAllocator(readBufferPool.get());
+        connectionTimeouts = std::make_unique<TimerWheel>(std::clamp<uint64_t>(profile.timeout / 8, 1, TIMEOUT_TICK_MS),
+            [this](auto& entry) { expireConnection(entry); });
+        connectionTimer = loop->resource<uvw::TimerHandle>();
+        connectionTimer->on<uvw::TimerEvent>([this](auto&, auto& handle) {
+            connectionTimeouts->advance(loop->now().count());
+            sampleBufferMemory();
+            if (connectionTimeouts->size() == 0)
+                handle.stop();
+        });
+    }
+
+    void sampleBufferMemory()
+    {
+        uint64_t now = loop->now().count();
+        if (now - lastBufferSample < TIMEOUT_TICK_MS)
+            return;
+        lastBufferSample = now;
+        uint64_t bytes = 0;
+        inComingConnections.forEach([&bytes](ConnectionContext& ctx) { bytes += ctx.bufferBytes(); });
+        if (bytes > peakBufferBytes) {
+            peakBufferBytes = bytes;
+            peakBufferConnections = inComingConnections.size();
+        }
+    }
+
+    void logReadBufferStats()
+    {
+        if (!verbose)
+            return;
+        auto& stats = readBufferPool->stats();
+        LOGI("read buffers: %llu heap allocations, %llu reuses, %llu heap frees",
+            static_cast<unsigned long long>(stats.heapAllocations),
+            static_cast<unsigned long long>(stats.reuses),
+            static_cast<unsigned long long>(stats.heapFrees));
+    }
+
+    void logConnectionStats()
+    {
+        if (!verbose)
+            return;
+        auto s = stats();
+        LOGI("tcp timeouts: %llu connect, %llu idle", static_cast<unsigned long long>(s.connectTimeouts),
+            static_cast<unsigned long long>(s.idleTimeouts));
+        if (s.fastOpenAccepted || s.fastOpenFallbacks)
+            LOGI("tcp fast open: %llu accepted, %llu fallbacks", static_cast<unsigned long long>(s.fastOpenAccepted),
+                static_cast<unsigned long long>(s.fastOpenFallbacks));
+        if (s.poolHits || s.poolMisses)
+            LOGI("remote pool: %llu hits, %llu misses (%.1f%% hit rate), %llu ms of handshakes saved",
+                static_cast<unsigned long long>(s.poolHits), static_cast<unsigned long long>(s.poolMisses),
+                100.0 * s.poolHits / (s.poolHits + s.poolMisses), static_cast<unsigned long long>(s.poolSavedMs));
+        LOGI("backpressure: %llu pauses, peak write queue %llu bytes", static_cast<unsigned long long>(s.backpressurePauses),
+            static_cast<unsigned long long>(s.peakQueuedBytes));
+        if (s.peakBufferConnections)
+            LOGI("buffer memory: peak %llu KiB with %llu connections open, %.1f KiB per connection",
+                static_cast<unsigned long long>(s.peakBufferBytes / 1024), static_cast<unsigned long long>(s.peakBufferConnections),
+                s.peakBufferBytes / 1024.0 / s.peakBufferConnections);
+    }
+
+    void logUDPSessionStats()
+    {
+        if (!verbose || !udpRelay)
+            return;
+        auto stats = udpRelay->stats();
+        LOGI("udp sessions: %zu active, %llu expired (%.2f/s), %llu datagrams dropped", stats.sessions,
+            static_cast<unsigned long long>(stats.expired), stats.expiredPerSecond,
+            static_cast<unsigned long long>(stats.dropped));
+    }
+
+    // the address of the server is looked up again every ttl, a failed lookup keeps the old one.
+    void startRemoteRefresh()
+    {
+        sockaddr_storage literal;
+        if (uv_ip4_addr(profile.remote_host, profile.remote_port, reinterpret_cast<sockaddr_in*>(&literal)) == 0
+            || uv_ip6_addr(profile.remote_host, profile.remote_port, reinterpret_cast<sockaddr_in6*>(&literal)) == 0)
+            return;
+        // tcp goes through the plugin, which resolves on its own.
+        if (profile.plugin && !udpRelay)
+            return;
+        resolver = std::make_unique<DNSResolver>(loop);
+        dnsRefreshTimer = loop->resource<uvw::TimerHandle>();
+        dnsRefreshTimer->on<uvw::TimerEvent>([this](auto&, auto&) {
+            resolver->resolve(profile.remote_host, profile.remote_port, profile.ipv6first, [this](int af, const sockaddr_storage& addr, const sockaddr_storage& alternative) {
+                if (af == -1 || stopping())
+                    return;
+                if (!profile.plugin) {
+                    updateRemoteAddress(addr);
+                    remoteAltAddr = alternative;
+                }
+                if (udpRelay)
+                    udpRelay->remoteAddress(addr);
+            });
+        });
+        auto ttl = uvw::TimerHandle::Time { resolver->ttl() };
+        dnsRefreshTimer->start(ttl, ttl);
+    }
+
+    void startRemotePool()
+    {
+        if (profile.remote_pool <= 0)
+            return;
+        remotePool = std::make_unique<RemotePool>(loop, profile.remote_pool, profile.remote_pool_idle);
+        bool altFirst = remoteAltAddr.ss_family != 0 && remoteAltAddr.ss_family == preferredFamily;
+        remotePool->fill(altFirst ? remoteAltAddr : remoteAddr);
+    }
+
+    void updateRemoteAddress(const sockaddr_storage& addr)
+    {
+        size_t len = addr.ss_family == AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+        if (addr.ss_family == remoteAddr.ss_family && memcmp(&addr, &remoteAddr, len) == 0)
+            return;
+        char ip[INET6_ADDRSTRLEN] = { 0 };
+        if (addr.ss_family == AF_INET6)
+            uv_ip6_name(reinterpret_cast<const sockaddr_in6*>(&addr), ip, sizeof(ip));
+        else
+            uv_ip4_name(reinterpret_cast<const sockaddr_in*>(&addr), ip, sizeof(ip));
+        LOGI("remote server %s now resolves to %s", profile.remote_host, ip);
+        remoteAddr = addr;
+    }
+
+    void startStopTimer()
+    {
+        stopTimer = loop->resource<uvw::TimerHandle>();
+        stopTimer->on<uvw::TimerEvent>([this](auto&, auto& handle) {
+            if (stopping()) {
+                if (!tcpServer || !tcpServer->closing()) {
+#ifdef SSR_UVW_WITH_QT
+                    if (statisticsUpdateTimer) {
+                        statisticsUpdateTimer->stop();
+                        statisticsUpdateTimer->close();
+                    }
+#endif
+                    if (tcpServer)
+                        tcpServer->close();
+                    inComingConnections.clear();
+                    connectionTimer->stop();
+                    connectionTimer->close();
+                    if (dnsRefreshTimer) {
+                        dnsRefreshTimer->stop();
+                        dnsRefreshTimer->close();
+                    }
+                    if (resolver)
+                        resolver->cancel();
+                    remotePool.reset();
+                    logUDPSessionStats();
+                    udpRelay.reset(nullptr);
+                    if (pluginProcess) {
+                        pluginProcess->kill(SIGTERM);
+                    }
+                }
+                int timer_count = 0;
+                uv_walk(
+                    loop->raw(),
+                    [](uv_handle_t* handle, void* arg) {
+                        int& counter = *static_cast<int*>(arg);
+                        if (uv_is_closing(handle) == 0)
+                            counter++;
+                    },
+                    &timer_count);
+                //only current timer
+                if (timer_count != 1)
+                    return;
+                handle.stop();
+                handle.close();
+                loop->clear();
+                loop->close();
+                cipherEnv.reset(nullptr);
+                loop->stop();
+            }
+        });
+        stopTimer->start(uvw::TimerHandle::Time { 500 }, uvw::TimerHandle::Time { 500 });
+    }
+
+    void startWorkers()
+    {
+        for (int i = 1; i < profile.workers; ++i) {
+            auto worker = std::make_unique<TCPRelayImpl>();
+            worker->parent = this;
+            workerThreads.emplace_back([w = worker.get(), p = profile, addr = remoteAddr, alt = remoteAltAddr]() mutable {
+                w->workerMain(p, addr, alt);
+            });
+            workers.emplace_back(std::move(worker));
+        }
+        if (!workers.empty())
+            LOGI("%d event loops share %s:%d", profile.workers, profile.local_addr, profile.local_port);
+    }
+
+    void joinWorkers()
+    {
+        for (auto& t : workerThreads) {
+            t.join();
+        }
+        workerThreads.clear();
+        // keep the counters of the workers in stats() once they are gone.
+        for (auto& worker : workers) {
+            connectTimeouts += worker->connectTimeouts;
+            idleTimeouts += worker->idleTimeouts;
+            fastOpenAccepted += worker->fastOpenAccepted;
+            fastOpenFallbacks += worker->fastOpenFallbacks;
+            poolHits += worker->poolHits;
+            poolMisses += worker->poolMisses;
+            poolSavedMs += worker->poolSavedMs;
+            backpressurePauses += worker->backpressurePauses;
+            peakQueuedBytes = std::max<uint64_t>(peakQueuedBytes, worker->peakQueuedBytes);
+            peakBufferBytes += worker->peakBufferBytes;
+            peakBufferConnections += worker->peakBufferConnections;
+        }
+        workers.clear();
+    }
+
+    // a worker only serves TCP, udp relay and plugin stay on the main loop.
+    void workerMain(profile_t& p, const sockaddr_storage& addr, const sockaddr_storage& alt)
+    {
+        verbose = p.verbose;
+        profile = p;
+        remoteAddr = addr;
+        remoteAltAddr = alt;
+        createLoop();
+        cipherEnv = std::make_unique<CipherEnv>(profile.password, profile.method, profile.key);
+        if (!cipherEnv->crypto) {
+            LOGE("initializing ciphers...%s failed", profile.method);
+            return;
+        }
+        startStopTimer();
+        // on failure the stop timer still tears the loop down once the main loop stops.
+        if (listen())
+            isStop = true;
+        else {
+            startRemoteRefresh();
+            startRemotePool();
+        }
+        loop->run();
+        logReadBufferStats();
+    }
 };
 
 std::shared_ptr<TCPRelay> TCPRelay::create()
@@ -22,6 +22,7 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <uv.h>
 
 #include "bloom.h"
 #include "ppbloom.h"
@@ -35,50 +36,74 @@ static int bloom_count[2];
 static int current;
 static int entries;
 static double error;
+static int initialized;
+
+/*
+ * The filter is shared by every event loop of the process,
+ * so all accesses are serialized.
+ */
+static uv_once_t ppbloom_once = UV_ONCE_INIT;
+static uv_mutex_t ppbloom_mutex;
+
+static void ppbloom_mutex_init(void)
+{
+    if (uv_mutex_init(&ppbloom_mutex))
+        FATAL("Failed to initialize ppbloom mutex");
+}
 
 int ppbloom_init(int n, double e)
 {
-    int err;
+    int err = 0;
+    uv_once(&ppbloom_once, ppbloom_mutex_init);
+    uv_mutex_lock(&ppbloom_mutex);
+    if (initialized)
+        goto out;
+
     entries = n / 2;
     error = e;
 
     err = bloom_init(ppbloom + PING, entries, error);
     if (err)
-        return err;
+        goto out;
 
     err = bloom_init(ppbloom + PONG, entries, error);
     if (err)
-        return err;
+        goto out;
 
     bloom_count[PING] = 0;
     bloom_count[PONG] = 0;
 
     current = PING;
+    initialized = 1;
 
-    return 0;
+out:
+    uv_mutex_unlock(&ppbloom_mutex);
+    return err;
 }
 
 int ppbloom_check(const void* buffer, int len)
 {
     int ret;
 
+    uv_mutex_lock(&ppbloom_mutex);
     ret = bloom_check(ppbloom + PING, buffer, len);
-    if (ret)
-        return ret;
-
-    ret = bloom_check(ppbloom + PONG, buffer, len);
-    if (ret)
-        return ret;
+    if (!ret)
+        ret = bloom_check(ppbloom + PONG, buffer, len);
+    uv_mutex_unlock(&ppbloom_mutex);
 
-    return 0;
+    return ret;
 }
 
 int ppbloom_add(const void* buffer, int len)
 {
     int err;
+
+    uv_mutex_lock(&ppbloom_mutex);
     err = bloom_add(ppbloom + current, buffer, len);
-    if (err == -1)
+    if (err == -1) {
+        uv_mutex_unlock(&ppbloom_mutex);
         return err;
+    }
 
     bloom_count[current]++;
 
@@ -87,12 +112,18 @@ int ppbloom_add(const void* buffer, int len)
         current = current == PING ? PONG : PING;
         bloom_reset(ppbloom + current);
     }
+    uv_mutex_unlock(&ppbloom_mutex);
 
     return 0;
 }
 
 void ppbloom_free()
 {
-    bloom_free(ppbloom + PING);
-    bloom_free(ppbloom + PONG);
+    uv_mutex_lock(&ppbloom_mutex);
+    if (initialized) {
+        bloom_free(ppbloom + PING);
+        bloom_free(ppbloom + PONG);
+        initialized = 0;
+    }
+    uv_mutex_unlock(&ppbloom_mutex);
 }
@@ -28,6 +28,11 @@ extern "C"
         int mtu; // MTU of interface
         int verbose; // verbose mode
         int ipv6first;
+        int workers; // number of event loops sharing the local port, <= 1 is a single loop
+        int udp_offload; // enable UDP GSO/GRO for the udp relay, falls back when the kernel rejects it
+        int remote_pool; // connections to the server kept open ahead of time per event loop, 0 disables the pool
+        int remote_pool_idle; // ms a pooled connection may stay unused, the server drops idle ones
+        int coalesce_window; // ms the target address waits for the first client data to share its chunk, 0 sends it alone
     } profile_t;
 
     int start_ssr_uv_local_server(profile_t profile);
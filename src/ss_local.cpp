@@ -8,6 +8,8 @@
 #include "signal.h"
 #include "ssrutils.h"
 
+#include <thread>
+
 static void usage()
 {
     printf("\n");
@@ -55,11 +57,31 @@ static void usage()
     printf("\n");
     printf(
         "       [-u]                       Enable UDP relay.\n");
+    printf(
+        "       [--fast-open]              Enable TCP fast open to the server (Linux).\n");
     //    printf(
     //        "       [-U]                       Enable UDP relay and disable TCP relay.\n");
     printf("\n");
     printf(
         "       [--mtu <MTU>]              MTU of your network interface.\n");
+    printf(
+        "       [--udp-offload]            Use UDP GSO/GRO for the UDP relay (Linux).\n");
+    printf("\n");
+    printf(
+        "       [--workers <num>]          Number of event loops sharing the local port,\n");
+    printf(
+        "                                  0 means one per CPU core. The default is 1.\n");
+    printf("\n");
+    printf(
+        "       [--pool-size <num>]        Connections to the server opened ahead of time\n");
+    printf(
+        "                                  per event loop. The default is 0, no pool.\n");
+    printf(
+        "       [--pool-idle <seconds>]    How long a pooled connection may wait, default 10.\n");
+    printf(
+        "       [--coalesce-window <ms>]   How long the target address waits for the first\n");
+    printf(
+        "                                  data to share one packet, default 1. 0 disables.\n");
     printf("\n");
     printf(
         "       [--plugin <name>]          Enable SIP003 plugin. (Experimental)\n");
@@ -88,6 +110,12 @@ enum {
     GETOPT_VAL_PLUGIN_OPTS,
     GETOPT_VAL_PASSWORD,
     GETOPT_VAL_KEY,
+    GETOPT_VAL_WORKERS,
+    GETOPT_VAL_UDP_OFFLOAD,
+    GETOPT_VAL_FAST_OPEN,
+    GETOPT_VAL_POOL_SIZE,
+    GETOPT_VAL_POOL_IDLE,
+    GETOPT_VAL_COALESCE_WINDOW,
 };
 
 int main(int argc, char** argv)
@@ -101,9 +129,11 @@ int main(int argc, char** argv)
     p.remote_port = 0;
     p.timeout = 60000;
     p.mtu = 1500;
+    p.coalesce_window = 1;
     p.plugin = nullptr;
     p.plugin_opts = nullptr;
     p.password = "shadowsocksr-uvw";
+    p.workers = 1;
     opterr = 0;
     static struct option long_options[] = {
         { "mtu",         required_argument, NULL, GETOPT_VAL_MTU         },
@@ -111,6 +141,12 @@ int main(int argc, char** argv)
         { "plugin-opts", required_argument, NULL, GETOPT_VAL_PLUGIN_OPTS },
         { "password",    required_argument, NULL, GETOPT_VAL_PASSWORD    },
         { "key",         required_argument, NULL, GETOPT_VAL_KEY         },
+        { "workers",     required_argument, NULL, GETOPT_VAL_WORKERS     },
+        { "udp-offload", no_argument,       NULL, GETOPT_VAL_UDP_OFFLOAD },
+        { "fast-open",   no_argument,       NULL, GETOPT_VAL_FAST_OPEN   },
+        { "pool-size",   required_argument, NULL, GETOPT_VAL_POOL_SIZE   },
+        { "pool-idle",   required_argument, NULL, GETOPT_VAL_POOL_IDLE   },
+        { "coalesce-window", required_argument, NULL, GETOPT_VAL_COALESCE_WINDOW },
         { "help",        no_argument,       NULL, GETOPT_VAL_HELP        },
         { nullptr, 0, nullptr, 0 }
     };
@@ -133,6 +169,26 @@ int main(int argc, char** argv)
         case GETOPT_VAL_KEY:
             p.key=optarg;
             break;
+        case GETOPT_VAL_UDP_OFFLOAD:
+            p.udp_offload = 1;
+            break;
+        case GETOPT_VAL_FAST_OPEN:
+            p.fast_open = 1;
+            break;
+        case GETOPT_VAL_POOL_SIZE:
+            p.remote_pool = atoi(optarg);
+            break;
+        case GETOPT_VAL_POOL_IDLE:
+            p.remote_pool_idle = atoi(optarg) * 1000;
+            break;
+        case GETOPT_VAL_COALESCE_WINDOW:
+            p.coalesce_window = atoi(optarg);
+            break;
+        case GETOPT_VAL_WORKERS:
+            p.workers = atoi(optarg);
+            if (p.workers == 0)
+                p.workers = static_cast<int>(std::thread::hardware_concurrency());
+            break;
         case 's':
             p.remote_host = optarg;
             break;
@@ -235,8 +235,7 @@ void stream_cipher_ctx_init(cipher_ctx_t* ctx, int method, int enc)
     const char* ciphername = supported_stream_ciphers[method];
     const cipher_kt_t* cipher = stream_get_cipher_type(method);
 
-    ctx->evp = ss_malloc(sizeof(cipher_evp_t));
-    memset(ctx->evp, 0, sizeof(cipher_evp_t));
+    ctx->evp = &ctx->state.evp;
     cipher_evp_t* evp = ctx->evp;
 
     if (cipher == NULL) {
@@ -253,7 +252,6 @@ void stream_ctx_release(cipher_ctx_t* cipher_ctx)
 {
     if (cipher_ctx->chunk != NULL) {
         bfree(cipher_ctx->chunk);
-        ss_free(cipher_ctx->chunk);
         cipher_ctx->chunk = NULL;
     }
 
@@ -262,7 +260,6 @@ void stream_ctx_release(cipher_ctx_t* cipher_ctx)
     }
 
     mbedtls_cipher_free(cipher_ctx->evp);
-    ss_free(cipher_ctx->evp);
 }
 
 void cipher_ctx_set_nonce(cipher_ctx_t* cipher_ctx, uint8_t* nonce, size_t nonce_len,
@@ -283,9 +280,10 @@ void cipher_ctx_set_nonce(cipher_ctx_t* cipher_ctx, uint8_t* nonce, size_t nonce
 
     if (cipher->method == RC4_MD5) {
         unsigned char key_nonce[32];
+        unsigned char md5_key[16];
         memcpy(key_nonce, cipher->key, 16);
         memcpy(key_nonce + 16, nonce, 16);
-        true_key = crypto_md5(key_nonce, 32, NULL);
+        true_key = crypto_md5(key_nonce, 32, md5_key);
         nonce_len = 0;
     } else {
         true_key = cipher->key;
@@ -324,7 +322,34 @@ cipher_ctx_update(cipher_ctx_t* ctx, uint8_t* output, size_t* olen,
         (uint8_t*)output, olen);
 }
 
-int stream_encrypt_all(buffer_t* plaintext, cipher_t* cipher, size_t capacity)
+/* xor a segment of a salsa20/chacha20 stream that may start in the middle of a block */
+static void
+stream_xor_continue(cipher_ctx_t* cipher_ctx, uint8_t* output,
+    const uint8_t* input, size_t ilen)
+{
+    cipher_t* cipher = cipher_ctx->cipher;
+    size_t padding = cipher_ctx->counter % SODIUM_BLOCK_SIZE;
+    size_t head = 0;
+    if (padding) {
+        uint8_t block[SODIUM_BLOCK_SIZE] = { 0 };
+        head = min(SODIUM_BLOCK_SIZE - padding, ilen);
+        memcpy(block + padding, input, head);
+        crypto_stream_xor_ic(block, block, (uint64_t)(padding + head),
+            (const uint8_t*)cipher_ctx->nonce,
+            cipher_ctx->counter / SODIUM_BLOCK_SIZE, cipher->key,
+            cipher->method);
+        memcpy(output, block + padding, head);
+    }
+    if (ilen > head) {
+        crypto_stream_xor_ic(output + head, input + head, (uint64_t)(ilen - head),
+            (const uint8_t*)cipher_ctx->nonce,
+            (cipher_ctx->counter + head) / SODIUM_BLOCK_SIZE, cipher->key,
+            cipher->method);
+    }
+    cipher_ctx->counter += ilen;
+}
+
+int stream_encrypt_all(const buffer_t* plaintext, buffer_t* ciphertext, cipher_t* cipher, size_t capacity)
 {
     cipher_ctx_t cipher_ctx;
     stream_ctx_init(cipher, &cipher_ctx, 1);
@@ -332,10 +357,8 @@ int stream_encrypt_all(buffer_t* plaintext, cipher_t* cipher, size_t capacity)
     size_t nonce_len = cipher->nonce_len;
     int err = CRYPTO_OK;
 
-    static buffer_t tmp = { 0, 0, 0, NULL };
-    brealloc(&tmp, nonce_len + plaintext->len, capacity);
-    buffer_t* ciphertext = &tmp;
-    ciphertext->len = plaintext->len;
+    brealloc(ciphertext, nonce_len + plaintext->len, capacity);
+    size_t clen = plaintext->len;
 
     uint8_t* nonce = cipher_ctx.nonce;
     cipher_ctx_set_nonce(&cipher_ctx, nonce, nonce_len, 1);
@@ -352,7 +375,7 @@ int stream_encrypt_all(buffer_t* plaintext, cipher_t* cipher, size_t capacity)
             0, cipher->key, cipher->method);
     } else {
         err = cipher_ctx_update(&cipher_ctx, (uint8_t*)(ciphertext->data + nonce_len),
-            &ciphertext->len, (const uint8_t*)plaintext->data,
+            &clen, (const uint8_t*)plaintext->data,
             plaintext->len);
     }
 
@@ -361,37 +384,32 @@ int stream_encrypt_all(buffer_t* plaintext, cipher_t* cipher, size_t capacity)
     if (err)
         return CRYPTO_ERROR;
 
+    ciphertext->len = nonce_len + clen;
+
 #ifdef SS_DEBUG
     dump("PLAIN", plaintext->data, plaintext->len);
-    dump("CIPHER", ciphertext->data + nonce_len, ciphertext->len);
+    dump("CIPHER", ciphertext->data + nonce_len, clen);
     dump("NONCE", ciphertext->data, nonce_len);
 #endif
 
-    brealloc(plaintext, nonce_len + ciphertext->len, capacity);
-    memcpy(plaintext->data, ciphertext->data, nonce_len + ciphertext->len);
-    plaintext->len = nonce_len + ciphertext->len;
-
     return CRYPTO_OK;
 }
 
-int stream_encrypt(buffer_t* plaintext, cipher_ctx_t* cipher_ctx, size_t capacity)
+int stream_encrypt(const buffer_t* plaintext, buffer_t* ciphertext, cipher_ctx_t* cipher_ctx, size_t capacity)
 {
     if (cipher_ctx == NULL)
         return CRYPTO_ERROR;
 
     cipher_t* cipher = cipher_ctx->cipher;
 
-    static buffer_t tmp = { 0, 0, 0, NULL };
-
     int err = CRYPTO_OK;
     size_t nonce_len = 0;
     if (!cipher_ctx->init) {
         nonce_len = cipher_ctx->cipher->nonce_len;
     }
 
-    brealloc(&tmp, nonce_len + plaintext->len, capacity);
-    buffer_t* ciphertext = &tmp;
-    ciphertext->len = plaintext->len;
+    brealloc(ciphertext, nonce_len + plaintext->len, capacity);
+    size_t clen = plaintext->len;
 
     if (!cipher_ctx->init) {
         cipher_ctx_set_nonce(cipher_ctx, cipher_ctx->nonce, nonce_len, 1);
@@ -405,47 +423,29 @@ int stream_encrypt(buffer_t* plaintext, cipher_ctx_t* cipher_ctx, size_t capacit
     }
 
     if (cipher->method >= SALSA20) {
-        int padding = cipher_ctx->counter % SODIUM_BLOCK_SIZE;
-        brealloc(ciphertext, nonce_len + (padding + ciphertext->len) * 2, capacity);
-        if (padding) {
-            brealloc(plaintext, plaintext->len + padding, capacity);
-            memmove(plaintext->data + padding, plaintext->data, plaintext->len);
-            sodium_memzero(plaintext->data, padding);
-        }
-        crypto_stream_xor_ic((uint8_t*)(ciphertext->data + nonce_len),
-            (const uint8_t*)plaintext->data,
-            (uint64_t)(plaintext->len + padding),
-            (const uint8_t*)cipher_ctx->nonce,
-            cipher_ctx->counter / SODIUM_BLOCK_SIZE, cipher->key,
-            cipher->method);
-        cipher_ctx->counter += plaintext->len;
-        if (padding) {
-            memmove(ciphertext->data + nonce_len,
-                ciphertext->data + nonce_len + padding, ciphertext->len);
-        }
+        stream_xor_continue(cipher_ctx, (uint8_t*)(ciphertext->data + nonce_len),
+            (const uint8_t*)plaintext->data, plaintext->len);
     } else {
         err = cipher_ctx_update(cipher_ctx,
             (uint8_t*)(ciphertext->data + nonce_len),
-            &ciphertext->len, (const uint8_t*)plaintext->data,
+            &clen, (const uint8_t*)plaintext->data,
             plaintext->len);
         if (err) {
             return CRYPTO_ERROR;
         }
     }
 
+    ciphertext->len = nonce_len + clen;
+
 #ifdef SS_DEBUG
     dump("PLAIN", plaintext->data, plaintext->len);
-    dump("CIPHER", ciphertext->data + nonce_len, ciphertext->len);
+    dump("CIPHER", ciphertext->data + nonce_len, clen);
 #endif
 
-    brealloc(plaintext, nonce_len + ciphertext->len, capacity);
-    memcpy(plaintext->data, ciphertext->data, nonce_len + ciphertext->len);
-    plaintext->len = nonce_len + ciphertext->len;
-
     return CRYPTO_OK;
 }
 
-int stream_decrypt_all(buffer_t* ciphertext, cipher_t* cipher, size_t capacity)
+int stream_decrypt_all(const buffer_t* ciphertext, buffer_t* plaintext, cipher_t* cipher, size_t capacity)
 {
     size_t nonce_len = cipher->nonce_len;
     int err = CRYPTO_OK;
@@ -457,16 +457,15 @@ int stream_decrypt_all(buffer_t* ciphertext, cipher_t* cipher, size_t capacity)
     cipher_ctx_t cipher_ctx;
     stream_ctx_init(cipher, &cipher_ctx, 0);
 
-    static buffer_t tmp = { 0, 0, 0, NULL };
-    brealloc(&tmp, ciphertext->len, capacity);
-    buffer_t* plaintext = &tmp;
-    plaintext->len = ciphertext->len - nonce_len;
+    brealloc(plaintext, ciphertext->len, capacity);
+    size_t plen = ciphertext->len - nonce_len;
 
     uint8_t* nonce = cipher_ctx.nonce;
     memcpy(nonce, ciphertext->data, nonce_len);
 
     if (ppbloom_check((void*)nonce, nonce_len) == 1) {
         LOGE("crypto: stream: repeat IV detected");
+        stream_ctx_release(&cipher_ctx);
         return CRYPTO_ERROR;
     }
 
@@ -478,7 +477,7 @@ int stream_decrypt_all(buffer_t* ciphertext, cipher_t* cipher, size_t capacity)
             (uint64_t)(ciphertext->len - nonce_len),
             (const uint8_t*)nonce, 0, cipher->key, cipher->method);
     } else {
-        err = cipher_ctx_update(&cipher_ctx, (uint8_t*)plaintext->data, &plaintext->len,
+        err = cipher_ctx_update(&cipher_ctx, (uint8_t*)plaintext->data, &plen,
             (const uint8_t*)(ciphertext->data + nonce_len),
             ciphertext->len - nonce_len);
     }
@@ -488,6 +487,8 @@ int stream_decrypt_all(buffer_t* ciphertext, cipher_t* cipher, size_t capacity)
     if (err)
         return CRYPTO_ERROR;
 
+    plaintext->len = plen;
+
 #ifdef SS_DEBUG
     dump("PLAIN", plaintext->data, plaintext->len);
     dump("CIPHER", ciphertext->data + nonce_len, ciphertext->len - nonce_len);
@@ -496,44 +497,37 @@ int stream_decrypt_all(buffer_t* ciphertext, cipher_t* cipher, size_t capacity)
 
     ppbloom_add((void*)nonce, nonce_len);
 
-    brealloc(ciphertext, plaintext->len, capacity);
-    memcpy(ciphertext->data, plaintext->data, plaintext->len);
-    ciphertext->len = plaintext->len;
-
     return CRYPTO_OK;
 }
 
-int stream_decrypt(buffer_t* ciphertext, cipher_ctx_t* cipher_ctx, size_t capacity)
+int stream_decrypt(const buffer_t* ciphertext, buffer_t* plaintext, cipher_ctx_t* cipher_ctx, size_t capacity)
 {
     if (cipher_ctx == NULL)
         return CRYPTO_ERROR;
 
     cipher_t* cipher = cipher_ctx->cipher;
 
-    static buffer_t tmp = { 0, 0, 0, NULL };
-
     int err = CRYPTO_OK;
 
-    brealloc(&tmp, ciphertext->len, capacity);
-    buffer_t* plaintext = &tmp;
-    plaintext->len = ciphertext->len;
+    /* the part of the input left after the nonce */
+    const char* cdata = ciphertext->data;
+    size_t clen = ciphertext->len;
+
+    plaintext->len = 0;
 
     if (!cipher_ctx->init) {
         if (cipher_ctx->chunk == NULL) {
-            cipher_ctx->chunk = (buffer_t*)ss_malloc(sizeof(buffer_t));
-            memset(cipher_ctx->chunk, 0, sizeof(buffer_t));
+            cipher_ctx->chunk = &cipher_ctx->chunk_buf;
             balloc(cipher_ctx->chunk, cipher->nonce_len);
         }
 
-        size_t left_len = min(cipher->nonce_len - cipher_ctx->chunk->len,
-            ciphertext->len);
+        size_t left_len = min(cipher->nonce_len - cipher_ctx->chunk->len, clen);
 
         if (left_len > 0) {
-            memcpy(cipher_ctx->chunk->data + cipher_ctx->chunk->len, ciphertext->data, left_len);
-            memmove(ciphertext->data, ciphertext->data + left_len,
-                ciphertext->len - left_len);
+            memcpy(cipher_ctx->chunk->data + cipher_ctx->chunk->len, cdata, left_len);
+            cdata += left_len;
+            clen -= left_len;
             cipher_ctx->chunk->len += left_len;
-            ciphertext->len -= left_len;
         }
 
         if (cipher_ctx->chunk->len < cipher->nonce_len)
@@ -541,7 +535,6 @@ int stream_decrypt(buffer_t* ciphertext, cipher_ctx_t* cipher_ctx, size_t capaci
 
         uint8_t* nonce = cipher_ctx->nonce;
         size_t nonce_len = cipher->nonce_len;
-        plaintext->len -= left_len;
 
         memcpy(nonce, cipher_ctx->chunk->data, nonce_len);
         cipher_ctx_set_nonce(cipher_ctx, nonce, nonce_len, 0);
@@ -556,41 +549,28 @@ int stream_decrypt(buffer_t* ciphertext, cipher_ctx_t* cipher_ctx, size_t capaci
         }
     }
 
-    if (ciphertext->len <= 0)
+    if (clen <= 0)
         return CRYPTO_NEED_MORE;
 
+    brealloc(plaintext, clen, capacity);
+    size_t plen = clen;
+
     if (cipher->method >= SALSA20) {
-        int padding = cipher_ctx->counter % SODIUM_BLOCK_SIZE;
-        brealloc(plaintext, (plaintext->len + padding) * 2, capacity);
-
-        if (padding) {
-            brealloc(ciphertext, ciphertext->len + padding, capacity);
-            memmove(ciphertext->data + padding, ciphertext->data,
-                ciphertext->len);
-            sodium_memzero(ciphertext->data, padding);
-        }
-        crypto_stream_xor_ic((uint8_t*)plaintext->data,
-            (const uint8_t*)(ciphertext->data),
-            (uint64_t)(ciphertext->len + padding),
-            (const uint8_t*)cipher_ctx->nonce,
-            cipher_ctx->counter / SODIUM_BLOCK_SIZE, cipher->key,
-            cipher->method);
-        cipher_ctx->counter += ciphertext->len;
-        if (padding) {
-            memmove(plaintext->data, plaintext->data + padding, plaintext->len);
-        }
+        stream_xor_continue(cipher_ctx, (uint8_t*)plaintext->data,
+            (const uint8_t*)cdata, clen);
     } else {
-        err = cipher_ctx_update(cipher_ctx, (uint8_t*)plaintext->data, &plaintext->len,
-            (const uint8_t*)(ciphertext->data),
-            ciphertext->len);
+        err = cipher_ctx_update(cipher_ctx, (uint8_t*)plaintext->data, &plen,
+            (const uint8_t*)cdata, clen);
     }
 
     if (err)
         return CRYPTO_ERROR;
 
+    plaintext->len = plen;
+
 #ifdef SS_DEBUG
     dump("PLAIN", plaintext->data, plaintext->len);
-    dump("CIPHER", ciphertext->data, ciphertext->len);
+    dump("CIPHER", (char*)cdata, clen);
 #endif
 
     // Add to bloom filter
@@ -605,10 +585,6 @@ int stream_decrypt(buffer_t* ciphertext, cipher_ctx_t* cipher_ctx, size_t capaci
         }
     }
 
-    brealloc(ciphertext, plaintext->len, capacity);
-    memcpy(ciphertext->data, plaintext->data, plaintext->len);
-    ciphertext->len = plaintext->len;
-
     return CRYPTO_OK;
 }
 
@@ -41,10 +41,10 @@
 
 #include "crypto.h"
 
-int stream_encrypt_all(buffer_t*, cipher_t*, size_t);
-int stream_decrypt_all(buffer_t*, cipher_t*, size_t);
-int stream_encrypt(buffer_t*, cipher_ctx_t*, size_t);
-int stream_decrypt(buffer_t*, cipher_ctx_t*, size_t);
+int stream_encrypt_all(const buffer_t*, buffer_t*, cipher_t*, size_t);
+int stream_decrypt_all(const buffer_t*, buffer_t*, cipher_t*, size_t);
+int stream_encrypt(const buffer_t*, buffer_t*, cipher_ctx_t*, size_t);
+int stream_decrypt(const buffer_t*, buffer_t*, cipher_ctx_t*, size_t);
 
 void stream_ctx_init(cipher_t*, cipher_ctx_t*, int);
 void stream_ctx_release(cipher_ctx_t*);
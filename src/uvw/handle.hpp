@@ -37,9 +37,22 @@ protected:
         ref.publish(CloseEvent{});
     }
 
-    static void allocCallback(uv_handle_t *, std::size_t suggested, uv_buf_t *buf) {
-        auto size = static_cast<unsigned int>(suggested);
-        *buf = uv_buf_init(new char[size], size);
+    static void allocCallback(uv_handle_t *handle, std::size_t suggested, uv_buf_t *buf) {
+        T &ref = *(static_cast<T*>(handle->data));
+        auto *allocator = ref.loop().readBufferAllocator();
+
+        if(allocator) {
+            std::size_t len = 0;
+            char *data = allocator->allocate(suggested, len);
+            *buf = uv_buf_init(data, data ? static_cast<unsigned int>(len) : 0);
+        } else {
+            auto size = static_cast<unsigned int>(suggested);
+            *buf = uv_buf_init(new char[size], size);
+        }
+    }
+
+    static ReadBuffer readBuffer(T &ref, char *data, bool owner = true) noexcept {
+        return ReadBuffer{data, ReadBufferDeleter{ref.loop().readBufferAllocator(), owner}};
     }
 
     template<typename F, typename... Args>
@@ -131,6 +131,16 @@ UVW_INLINE void Loop::data(std::shared_ptr<void> uData) {
 }
 
 
+UVW_INLINE ReadBufferAllocator * Loop::readBufferAllocator() const noexcept {
+    return readAllocator;
+}
+
+
+UVW_INLINE void Loop::readBufferAllocator(ReadBufferAllocator *alloc) noexcept {
+    readAllocator = alloc;
+}
+
+
 UVW_INLINE const uv_loop_t *Loop::raw() const noexcept {
     return loop.get();
 }
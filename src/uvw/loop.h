@@ -37,6 +37,60 @@ enum class UVRunMode: std::underlying_type_t<uv_run_mode> {
 }
 
 
+/**
+ * @brief Allocator for the read buffers of the handles of a loop.
+ *
+ * When a loop has an allocator, stream and UDP handles draw the buffers of
+ * `uv_read_start` and `uv_udp_recv_start` from it and give them back once the
+ * data event is gone, instead of using `new char[]` for every read.
+ */
+struct ReadBufferAllocator {
+    virtual ~ReadBufferAllocator() = default;
+    /**
+     * @brief Gets a buffer.
+     * @param suggested The size suggested by `libuv`.
+     * @param len The actual size of the buffer returned.
+     * @return A buffer of `len` bytes, `nullptr` to report `UV_ENOBUFS`.
+     */
+    virtual char * allocate(std::size_t suggested, std::size_t &len) = 0;
+    /**
+     * @brief Gives back a buffer obtained from allocate.
+     * @param data The buffer.
+     */
+    virtual void deallocate(char *data) noexcept = 0;
+};
+
+
+/**
+ * @brief Deleter of the data carried by DataEvent and UDPDataEvent.
+ *
+ * Without an allocator it behaves as `std::default_delete<char[]>`. A
+ * non-owning deleter leaves the data alone, it is used for the datagrams of a
+ * `recvmmsg` batch, which live in the buffer of the batch.
+ */
+struct ReadBufferDeleter {
+    ReadBufferDeleter() noexcept = default;
+    ReadBufferDeleter(std::default_delete<char[]>) noexcept {}
+    explicit ReadBufferDeleter(ReadBufferAllocator *alloc, bool owns = true) noexcept: allocator{alloc}, owner{owns} {}
+
+    void operator()(char *data) const noexcept {
+        if(!owner) {
+            return;
+        } else if(allocator) {
+            allocator->deallocate(data);
+        } else {
+            delete[] data;
+        }
+    }
+
+    ReadBufferAllocator *allocator{nullptr};
+    bool owner{true};
+};
+
+
+using ReadBuffer = std::unique_ptr<char[], ReadBufferDeleter>;
+
+
 /**
  * @brief Untyped handle class
  *
@@ -384,6 +438,22 @@ public:
      */
     void data(std::shared_ptr<void> uData);
 
+    /**
+     * @brief Gets the allocator of the read buffers, if any.
+     * @return The allocator, `nullptr` if reads use `new char[]`.
+     */
+    ReadBufferAllocator * readBufferAllocator() const noexcept;
+
+    /**
+     * @brief Sets the allocator of the read buffers.
+     *
+     * The allocator must outlive every handle of the loop. Set it before the
+     * handles start reading.
+     *
+     * @param alloc The allocator, `nullptr` to go back to `new char[]`.
+     */
+    void readBufferAllocator(ReadBufferAllocator *alloc) noexcept;
+
     /**
      * @brief Gets the underlying raw data structure.
      *
@@ -421,6 +491,7 @@ public:
 private:
     std::unique_ptr<uv_loop_t, Deleter> loop;
     std::shared_ptr<void> userData{nullptr};
+    ReadBufferAllocator *readAllocator{nullptr};
 };
 
 
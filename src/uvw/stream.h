@@ -62,9 +62,9 @@ struct WriteEvent {};
  * It will be emitted by StreamHandle according with its functionalities.
  */
 struct DataEvent {
-    explicit DataEvent(std::unique_ptr<char[]> buf, std::size_t len) noexcept;
+    explicit DataEvent(ReadBuffer buf, std::size_t len) noexcept;
 
-    std::unique_ptr<char[]> data; /*!< A bunch of data read on the stream. */
+    ReadBuffer data; /*!< A bunch of data read on the stream. */
     std::size_t length; /*!< The amount of data read on the stream. */
 };
 
@@ -114,6 +114,26 @@ private:
 };
 
 
+template<typename Owner>
+class WriteVecReq final: public Request<WriteVecReq<Owner>, uv_write_t> {
+    using ConstructorAccess = typename Request<WriteVecReq<Owner>, uv_write_t>::ConstructorAccess;
+
+public:
+    WriteVecReq(ConstructorAccess ca, std::shared_ptr<Loop> loop, Owner own)
+        : Request<WriteVecReq<Owner>, uv_write_t>{ca, std::move(loop)},
+          owner{std::move(own)}
+    {}
+
+    void write(uv_stream_t *handle, const uv_buf_t bufs[], unsigned int nbufs) {
+        // libuv copies the array of buffers, only the memory they point to has to stay.
+        this->invoke(&uv_write, this->get(), handle, bufs, nbufs, &this->template defaultCallback<WriteEvent>);
+    }
+
+private:
+    Owner owner;
+};
+
+
 }
 
 
@@ -131,7 +151,7 @@ class StreamHandle: public Handle<T, U> {
     static void readCallback(uv_stream_t *handle, ssize_t nread, const uv_buf_t *buf) {
         T &ref = *(static_cast<T*>(handle->data));
         // data will be destroyed no matter of what the value of nread is
-        std::unique_ptr<char[]> data{buf->base};
+        ReadBuffer data = Handle<T, U>::readBuffer(ref, buf->base);
 
         // nread == 0 is ignored (see http://docs.libuv.org/en/v1.x/stream.html)
         // equivalent to EAGAIN/EWOULDBLOCK, it shouldn't be treated as an error
@@ -287,6 +307,33 @@ public:
         req->write(this->template get<uv_stream_t>());
     }
 
+    /**
+     * @brief Writes several buffers to the stream with a single request.
+     *
+     * The buffers are written in order, as if they were one. The handle takes
+     * the ownership of `owner`, which must keep the memory the buffers point
+     * to alive, and releases it once the request is done. The array of
+     * buffers is copied, it is not used after the call returns.
+     *
+     * A WriteEvent event will be emitted when the data have been written.<br/>
+     * An ErrorEvent event will be emitted in case of errors.
+     *
+     * @param owner Whatever owns the memory of the buffers.
+     * @param bufs The buffers to be written to the stream.
+     * @param nbufs The number of buffers.
+     */
+    template<typename Owner>
+    void write(Owner owner, const uv_buf_t bufs[], unsigned int nbufs) {
+        auto req = this->loop().template resource<details::WriteVecReq<Owner>>(std::move(owner));
+        auto listener = [ptr = this->shared_from_this()](const auto &event, const auto &) {
+            ptr->publish(event);
+        };
+
+        req->template once<ErrorEvent>(listener);
+        req->template once<WriteEvent>(listener);
+        req->write(this->template get<uv_stream_t>(), bufs, nbufs);
+    }
+
     /**
      * @brief Extended write function for sending handles over a pipe handle.
      *
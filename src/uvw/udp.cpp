@@ -8,7 +8,7 @@
 namespace uvw {
 
 
-UVW_INLINE UDPDataEvent::UDPDataEvent(Addr sndr, std::unique_ptr<char[]> buf, std::size_t len, bool part) noexcept
+UVW_INLINE UDPDataEvent::UDPDataEvent(Addr sndr, ReadBuffer buf, std::size_t len, bool part) noexcept
     : data{std::move(buf)}, length{len}, sender{std::move(sndr)}, partial{part}
 {}
 
@@ -244,7 +244,7 @@ UVW_INLINE int UDPHandle::trySend(Addr addr, char *data, unsigned int len) {
 
 template<typename I>
 UVW_INLINE void UDPHandle::recv() {
-    invoke(&uv_udp_recv_start, get(), &allocCallback, &recvCallback<I>);
+    invoke(&uv_udp_recv_start, get(), &recvAllocCallback, &recvCallback<I>);
 }
 
 
@@ -30,9 +30,9 @@ struct SendEvent {};
  * It will be emitted by UDPHandle according with its functionalities.
  */
 struct UDPDataEvent {
-    explicit UDPDataEvent(Addr sndr, std::unique_ptr<char[]> buf, std::size_t len, bool part) noexcept;
+    explicit UDPDataEvent(Addr sndr, ReadBuffer buf, std::size_t len, bool part) noexcept;
 
-    std::unique_ptr<char[]> data; /*!< A bunch of data read on the stream. */
+    ReadBuffer data; /*!< A bunch of data read on the stream. */
     std::size_t length;  /*!< The amount of data read on the stream. */
     Addr sender; /*!< A valid instance of Addr. */
     bool partial; /*!< True if the message was truncated, false otherwise. */
@@ -91,13 +91,32 @@ private:
  * for further details.
  */
 class UDPHandle final: public Handle<UDPHandle, uv_udp_t> {
+    // datagrams read by one recvmmsg call, libuv caps it at 20
+    static constexpr std::size_t MMSG_BATCH = 20;
+
+    static void recvAllocCallback(uv_handle_t *handle, std::size_t suggested, uv_buf_t *buf) {
+#if UV_VERSION_HEX >= ((1 << 16) | (39 << 8))
+        // with recvmmsg libuv splits the buffer in chunks of the suggested size, one per datagram
+        if(uv_udp_using_recvmmsg(reinterpret_cast<const uv_udp_t *>(handle))) {
+            suggested *= MMSG_BATCH;
+        }
+#endif
+        allocCallback(handle, suggested, buf);
+    }
+
     template<typename I>
     static void recvCallback(uv_udp_t *handle, ssize_t nread, const uv_buf_t *buf, const sockaddr *addr, unsigned flags) {
         const typename details::IpTraits<I>::Type *aptr = reinterpret_cast<const typename details::IpTraits<I>::Type *>(addr);
 
         UDPHandle &udp = *(static_cast<UDPHandle*>(handle->data));
-        // data will be destroyed no matter of what the value of nread is
-        std::unique_ptr<char[]> data{buf->base};
+        // data will be destroyed no matter of what the value of nread is, but a
+        // datagram of a recvmmsg batch belongs to the buffer of the batch, which
+        // comes back with nread == 0 and addr == nullptr once the batch is done
+#if UV_VERSION_HEX >= ((1 << 16) | (39 << 8))
+        ReadBuffer data = readBuffer(udp, buf->base, !(flags & UV_UDP_MMSG_CHUNK));
+#else
+        ReadBuffer data = readBuffer(udp, buf->base, true);
+#endif
 
         if(nread > 0) {
             // data available (can be truncated)
@@ -2,6 +2,7 @@
 #include "uvw/tcp.h"
 #include "uvw/udp.h"
 #include <Buffer.hpp>
+#include <cstring>
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
 
@@ -20,13 +21,11 @@ TEST_CASE("newBuf", "[BufferTest]")
 TEST_CASE("drop", "[BufferTest]")
 {
     auto buf = Buffer();
-    auto begin = buf.begin();
-    auto back = buf.back();
-    REQUIRE(begin == back);
+    REQUIRE(buf.begin() == buf.back());
     char a[] { 0x05, 0x00, 0x01, 0x03 };
     buf.copyFromBegin(a, 4);
     REQUIRE(buf.length() == 4);
-    REQUIRE(buf.back() == begin + 4);
+    REQUIRE(buf.back() == buf.begin() + 4);
     buf.drop(3);
     REQUIRE(*buf.begin() == 0x03);
     buf.drop(1);
@@ -62,6 +61,45 @@ TEST_CASE("DuplicatDataToArray", "[BufferTest]")
     }
 }
 
+TEST_CASE("Release", "[BufferTest]")
+{
+    auto buf = Buffer();
+    char a[] { 0x05, 0x01, 0x00 };
+    buf.copyFromBegin(a, 3);
+    auto data = buf.begin();
+    auto storage = buf.release();
+    REQUIRE(storage.get() == data);
+    REQUIRE(memcmp(storage.get(), a, 3) == 0);
+    REQUIRE(buf.length() == 0);
+    REQUIRE(buf.capacity() == 0);
+    REQUIRE(buf.begin() == nullptr);
+    // the released block goes back to the pool and is handed out again.
+    auto pooled = BufferPool::pooledCount();
+    storage.reset();
+    REQUIRE(BufferPool::pooledCount() == pooled + 1);
+    buf.copyFromBegin(a, 3);
+    REQUIRE(buf.begin() == data);
+}
+
+TEST_CASE("Lazy", "[BufferTest]")
+{
+    auto buf = Buffer();
+    REQUIRE(buf.capacity() == 0);
+    char a[] { 0x05, 0x01, 0x00 };
+    buf.copyFromBegin(a, 3);
+    REQUIRE(buf.capacity() == Buffer::BUF_DEFAULT_CAPACITY);
+    auto pooled = BufferPool::pooledCount();
+    // the block is only held while data is in the buffer.
+    buf.drop(3);
+    REQUIRE(buf.capacity() == 0);
+    REQUIRE(BufferPool::pooledCount() == pooled + 1);
+    buf.copyFromBegin(a, 3);
+    REQUIRE(BufferPool::pooledCount() == pooled);
+    buf.clear();
+    REQUIRE(buf.capacity() == 0);
+    REQUIRE(BufferPool::pooledCount() == pooled + 1);
+}
+
 TEST_CASE("CopyEvent", "[BufferTest]")
 {
     constexpr auto fake_data_length = 16584;
@@ -111,3 +149,62 @@ TEST_CASE("UDPCopyEvent", "[BufferTest]")
     buf.copy(event); // no data to copy, because it's length is zero.
     REQUIRE(buf.length() == fake_data_length * 2);
 }
+
+TEST_CASE("ReadBufferPool", "[BufferTest]")
+{
+    ReadBufferPool pool { 1024, 1 };
+    size_t len = 0;
+    auto first = pool.allocate(1024, len);
+    REQUIRE(len == 1024);
+    auto second = pool.allocate(512, len);
+    REQUIRE(len == 1024);
+    REQUIRE(pool.stats().heapAllocations == 2);
+    REQUIRE(pool.stats().outstanding == 2);
+    pool.deallocate(first);
+    pool.deallocate(second);
+    // only one slab is cached, the other one is freed.
+    REQUIRE(pool.stats().heapFrees == 1);
+    REQUIRE(pool.stats().outstanding == 0);
+    REQUIRE(pool.allocate(1024, len) == first);
+    REQUIRE(pool.stats().reuses == 1);
+    pool.deallocate(first);
+    // larger requests get a multiple of the slab size.
+    auto batch = pool.allocate(3000, len);
+    REQUIRE(len == 3072);
+    pool.deallocate(batch);
+    REQUIRE(pool.allocate(2048, len) == batch);
+    REQUIRE(len == 3072);
+    pool.deallocate(batch);
+    REQUIRE(pool.stats().outstanding == 0);
+}
+
+TEST_CASE("ReadBufferPoolUDP", "[BufferTest]")
+{
+    constexpr int packets = 8;
+    auto loop = uvw::Loop::create();
+    ReadBufferPool pool;
+    loop->readBufferAllocator(&pool);
+    auto server = loop->resource<uvw::UDPHandle>();
+    auto client = loop->resource<uvw::UDPHandle>();
+    server->bind("127.0.0.1", 0);
+    int received = 0;
+    server->on<uvw::UDPDataEvent>([&](const uvw::UDPDataEvent& event, uvw::UDPHandle& handle) {
+        REQUIRE(event.length == 4);
+        REQUIRE(memcmp(event.data.get(), "ping", 4) == 0);
+        if (++received == packets) {
+            handle.close();
+            client->close();
+        }
+    });
+    server->recv();
+    auto port = server->sock().port;
+    for (int i = 0; i < packets; ++i) {
+        client->send("127.0.0.1", port, const_cast<char*>("ping"), 4);
+    }
+    loop->run();
+    REQUIRE(received == packets);
+    // the steady state read path does not touch the heap.
+    REQUIRE(pool.stats().heapAllocations == 1);
+    REQUIRE(pool.stats().reuses >= packets - 1);
+    REQUIRE(pool.stats().outstanding == 0);
+}
@@ -0,0 +1,525 @@
+extern "C"
+{
+#include "aesgcm.h"
+#include "crypto.h"
+#include "ppbloom.h"
+}
+#include "BufferPool.hpp"
+#include <mbedtls/gcm.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "catch.hpp"
+
+namespace
+{
+struct BufferDeleter
+{
+    void operator()(buffer_t* buf)
+    {
+        bfree(buf);
+        free(buf);
+    }
+};
+using BufferPtr = std::unique_ptr<buffer_t, BufferDeleter>;
+
+BufferPtr makeBuf()
+{
+    auto buf = reinterpret_cast<buffer_t*>(malloc(sizeof(buffer_t)));
+    balloc(buf, 16);
+    buf->len = 0;
+    return BufferPtr { buf };
+}
+
+buffer_t inputBuf(const std::vector<char>& data, size_t offset, size_t len)
+{
+    return buffer_t { 0, len, len, const_cast<char*>(data.data() + offset) };
+}
+
+std::vector<char> randomData(size_t len)
+{
+    std::vector<char> data(len);
+    rand_bytes(data.data(), static_cast<int>(len));
+    return data;
+}
+
+// the encryptor and the decryptor share the process wide bloom filter, start the decryptor with an empty one.
+void resetBloom()
+{
+    ppbloom_free();
+    ppbloom_init(BF_NUM_ENTRIES_FOR_CLIENT, BF_ERROR_RATE_FOR_CLIENT);
+}
+
+// one method per aead kernel, and two stream ciphers.
+const char* methods[] { "chacha20-ietf-poly1305", "xchacha20-ietf-poly1305", "aes-128-gcm", "aes-192-gcm", "aes-256-gcm",
+    "chacha20-ietf", "salsa20" };
+} // namespace
+
+TEST_CASE("stream round trip", "[CryptoTest]")
+{
+    // piece sizes cross the aead chunk limit and the 64 bytes block of salsa20/chacha20.
+    const size_t encPieces[] { 1, 63, 100, 0x3FFF, 0x3FFF + 1, 40000 };
+    const size_t decPieces[] { 7, 1, 1000, 33, 65536 };
+    for (auto method : methods) {
+        SECTION(method)
+        {
+            crypto_t* crypto = crypto_init("test-password", nullptr, method);
+            REQUIRE(crypto != nullptr);
+            cipher_ctx_t e_ctx, d_ctx;
+            crypto->ctx_init(crypto->cipher, &e_ctx, 1);
+            crypto->ctx_init(crypto->cipher, &d_ctx, 0);
+
+            size_t total = 0;
+            for (auto piece : encPieces)
+                total += piece;
+            auto plain = randomData(total);
+            std::vector<char> cipherText;
+            auto out = makeBuf();
+            size_t offset = 0;
+            for (auto piece : encPieces) {
+                auto in = inputBuf(plain, offset, piece);
+                REQUIRE(crypto->encrypt(&in, out.get(), &e_ctx, 16) == CRYPTO_OK);
+                cipherText.insert(cipherText.end(), out->data, out->data + out->len);
+                offset += piece;
+            }
+
+            resetBloom();
+            std::vector<char> decrypted;
+            offset = 0;
+            for (size_t i = 0; offset < cipherText.size(); ++i) {
+                size_t piece = std::min(decPieces[i % std::size(decPieces)], cipherText.size() - offset);
+                auto in = inputBuf(cipherText, offset, piece);
+                int err = crypto->decrypt(&in, out.get(), &d_ctx, 16);
+                REQUIRE(err != CRYPTO_ERROR);
+                if (err == CRYPTO_OK)
+                    decrypted.insert(decrypted.end(), out->data, out->data + out->len);
+                offset += piece;
+            }
+            REQUIRE(decrypted == plain);
+
+            crypto->ctx_release(&e_ctx);
+            crypto->ctx_release(&d_ctx);
+        }
+    }
+}
+
+TEST_CASE("packet round trip", "[CryptoTest]")
+{
+    for (auto method : methods) {
+        SECTION(method)
+        {
+            crypto_t* crypto = crypto_init("test-password", nullptr, method);
+            REQUIRE(crypto != nullptr);
+            auto plain = randomData(1400);
+            auto cipherText = makeBuf();
+            auto decrypted = makeBuf();
+            auto in = inputBuf(plain, 0, plain.size());
+            REQUIRE(crypto->encrypt_all(&in, cipherText.get(), crypto->cipher, 16) == CRYPTO_OK);
+            REQUIRE(cipherText->len > plain.size());
+
+            resetBloom();
+            REQUIRE(crypto->decrypt_all(cipherText.get(), decrypted.get(), crypto->cipher, 16) == CRYPTO_OK);
+            REQUIRE(decrypted->len == plain.size());
+            REQUIRE(memcmp(decrypted->data, plain.data(), plain.size()) == 0);
+            // replayed packet is rejected
+            REQUIRE(crypto->decrypt_all(cipherText.get(), decrypted.get(), crypto->cipher, 16) == CRYPTO_ERROR);
+        }
+    }
+}
+
+TEST_CASE("vectored stream round trip", "[CryptoTest]")
+{
+    const size_t encPieces[] { 1, 0x3FFF, 0x3FFF + 1, 65536 };
+    const char* aeadMethods[] { "chacha20-ietf-poly1305", "xchacha20-ietf-poly1305", "aes-128-gcm", "aes-256-gcm" };
+    for (auto method : aeadMethods) {
+        SECTION(method)
+        {
+            crypto_t* crypto = crypto_init("test-password", nullptr, method);
+            REQUIRE(crypto != nullptr);
+            REQUIRE(crypto->encrypt_vec != nullptr);
+            cipher_ctx_t e_ctx, d_ctx;
+            crypto->ctx_init(crypto->cipher, &e_ctx, 1);
+            crypto->ctx_init(crypto->cipher, &d_ctx, 0);
+
+            std::vector<char> plain, cipherText;
+            auto frame = makeBuf();
+            for (auto piece : encPieces) {
+                auto data = randomData(piece);
+                plain.insert(plain.end(), data.begin(), data.end());
+                auto in = inputBuf(data, 0, piece);
+                buffer_t vec[2 * 5 + 1];
+                size_t nvec = std::size(vec);
+                REQUIRE(crypto->encrypt_vec(&in, frame.get(), vec, &nvec, &e_ctx, 16) == CRYPTO_OK);
+                REQUIRE(nvec == 2 * ((piece + 0x3FFF - 1) / 0x3FFF) + 1);
+                for (size_t i = 0; i < nvec; ++i)
+                    cipherText.insert(cipherText.end(), vec[i].data, vec[i].data + vec[i].len);
+            }
+            // more chunks than pieces
+            auto big = randomData(0x3FFF * 6);
+            auto in = inputBuf(big, 0, big.size());
+            buffer_t vec[2 * 5 + 1];
+            size_t nvec = std::size(vec);
+            REQUIRE(crypto->encrypt_vec(&in, frame.get(), vec, &nvec, &e_ctx, 16) == CRYPTO_ERROR);
+
+            resetBloom();
+            auto out = makeBuf();
+            auto all = inputBuf(cipherText, 0, cipherText.size());
+            REQUIRE(crypto->decrypt(&all, out.get(), &d_ctx, 16) == CRYPTO_OK);
+            REQUIRE(std::vector<char>(out->data, out->data + out->len) == plain);
+
+            crypto->ctx_release(&e_ctx);
+            crypto->ctx_release(&d_ctx);
+        }
+    }
+}
+
+TEST_CASE("vectored stream decrypt", "[CryptoTest]")
+{
+    // many small frames per read, more than vec has room for.
+    const size_t encPieces[] { 1, 10, 200, 0x3FFF, 0x3FFF + 1, 3000, 5, 5, 5, 5, 5, 5, 65536 };
+    const size_t decPieces[] { 7, 1, 1000, 33, 65536, 20000 };
+    const char* aeadMethods[] { "chacha20-ietf-poly1305", "xchacha20-ietf-poly1305", "aes-128-gcm", "aes-256-gcm" };
+    for (auto method : aeadMethods) {
+        SECTION(method)
+        {
+            crypto_t* crypto = crypto_init("test-password", nullptr, method);
+            REQUIRE(crypto != nullptr);
+            REQUIRE(crypto->decrypt_vec != nullptr);
+            cipher_ctx_t e_ctx, d_ctx;
+            crypto->ctx_init(crypto->cipher, &e_ctx, 1);
+            crypto->ctx_init(crypto->cipher, &d_ctx, 0);
+
+            std::vector<char> plain, cipherText;
+            auto out = makeBuf();
+            for (auto piece : encPieces) {
+                auto data = randomData(piece);
+                plain.insert(plain.end(), data.begin(), data.end());
+                auto in = inputBuf(data, 0, piece);
+                REQUIRE(crypto->encrypt(&in, out.get(), &e_ctx, 16) == CRYPTO_OK);
+                cipherText.insert(cipherText.end(), out->data, out->data + out->len);
+            }
+
+            resetBloom();
+            std::vector<char> decrypted;
+            size_t offset = 0;
+            for (size_t i = 0; offset < cipherText.size(); ++i) {
+                size_t piece = std::min(decPieces[i % std::size(decPieces)], cipherText.size() - offset);
+                // opened in place, the read is not kept.
+                std::vector<char> read(cipherText.begin() + offset, cipherText.begin() + offset + piece);
+                auto in = inputBuf(read, 0, piece);
+                buffer_t vec[3];
+                size_t nvec = std::size(vec);
+                int err = crypto->decrypt_vec(&in, out.get(), vec, &nvec, &d_ctx, 16);
+                REQUIRE(err != CRYPTO_ERROR);
+                if (err == CRYPTO_OK) {
+                    REQUIRE(nvec > 0);
+                    for (size_t j = 0; j < nvec; ++j)
+                        decrypted.insert(decrypted.end(), vec[j].data, vec[j].data + vec[j].len);
+                }
+                offset += piece;
+            }
+            REQUIRE(decrypted == plain);
+
+            crypto->ctx_release(&e_ctx);
+            crypto->ctx_release(&d_ctx);
+        }
+    }
+}
+
+TEST_CASE("partial frames reuse the pooled chunk", "[CryptoTest]")
+{
+    crypto_t* crypto = crypto_init("test-password", nullptr, "chacha20-ietf-poly1305");
+    REQUIRE(crypto != nullptr);
+    cipher_ctx_t e_ctx, d_ctx;
+    crypto->ctx_init(crypto->cipher, &e_ctx, 1);
+    crypto->ctx_init(crypto->cipher, &d_ctx, 0);
+
+    std::vector<char> cipherText;
+    auto out = makeBuf();
+    for (int i = 0; i < 2; ++i) {
+        auto data = randomData(100);
+        auto in = inputBuf(data, 0, data.size());
+        REQUIRE(crypto->encrypt(&in, out.get(), &e_ctx, 16) == CRYPTO_OK);
+        cipherText.insert(cipherText.end(), out->data, out->data + out->len);
+    }
+    // the salt, the first frame split in two, then half of the second frame.
+    size_t salt = crypto->cipher->key_len;
+    size_t frame = (cipherText.size() - salt) / 2;
+    const size_t pieces[] { salt + frame / 2, frame - frame / 2, frame / 2 };
+
+    resetBloom();
+    size_t offset = 0;
+    auto decrypt = [&](size_t piece) {
+        auto in = inputBuf(cipherText, offset, piece);
+        offset += piece;
+        return crypto->decrypt(&in, out.get(), &d_ctx, 16);
+    };
+    REQUIRE(decrypt(pieces[0]) == CRYPTO_NEED_MORE);
+    REQUIRE(d_ctx.chunk != nullptr);
+    REQUIRE(d_ctx.chunk->capacity == BPOOL_CHUNK_CAPACITY);
+    auto block = d_ctx.chunk->data;
+    auto pooled = BufferPool::pooledChunkCount();
+    REQUIRE(decrypt(pieces[1]) == CRYPTO_OK);
+    REQUIRE(d_ctx.chunk == nullptr);
+    REQUIRE(BufferPool::pooledChunkCount() == pooled + 1);
+    REQUIRE(decrypt(pieces[2]) == CRYPTO_NEED_MORE);
+    REQUIRE(d_ctx.chunk->data == block);
+    REQUIRE(BufferPool::pooledChunkCount() == pooled);
+
+    crypto->ctx_release(&e_ctx);
+    crypto->ctx_release(&d_ctx);
+}
+
+TEST_CASE("aead length block is the plain aead", "[CryptoTest]")
+{
+    // the length block of the chacha and aes-gcm kernels is sealed without the aead call, it must be the same bytes.
+    for (auto method : { "chacha20-ietf-poly1305", "xchacha20-ietf-poly1305", "aes-128-gcm", "aes-192-gcm" }) {
+        SECTION(method)
+        {
+            crypto_t* crypto = crypto_init("test-password", nullptr, method);
+            REQUIRE(crypto != nullptr);
+            cipher_ctx_t e_ctx;
+            crypto->ctx_init(crypto->cipher, &e_ctx, 1);
+            auto plain = randomData(300);
+            auto in = inputBuf(plain, 0, plain.size());
+            auto out = makeBuf();
+            REQUIRE(crypto->encrypt(&in, out.get(), &e_ctx, 16) == CRYPTO_OK);
+
+            const unsigned char len[2] { 300 >> 8, 300 & 0xff };
+            const unsigned char nonce[24] {};
+            unsigned char expected[2 + 16];
+            unsigned long long expectedLen = 0;
+            if (strcmp(method, "chacha20-ietf-poly1305") == 0) {
+                crypto_aead_chacha20poly1305_ietf_encrypt(expected, &expectedLen, len, 2, nullptr, 0, nullptr, nonce,
+                    e_ctx.skey);
+            } else if (strcmp(method, "xchacha20-ietf-poly1305") == 0) {
+                crypto_aead_xchacha20poly1305_ietf_encrypt(expected, &expectedLen, len, 2, nullptr, 0, nullptr, nonce,
+                    e_ctx.skey);
+            } else {
+                mbedtls_gcm_context gcm;
+                mbedtls_gcm_init(&gcm);
+                REQUIRE(mbedtls_gcm_setkey(&gcm, MBEDTLS_CIPHER_ID_AES, e_ctx.skey,
+                            static_cast<unsigned int>(crypto->cipher->key_len * 8))
+                    == 0);
+                REQUIRE(mbedtls_gcm_crypt_and_tag(&gcm, MBEDTLS_GCM_ENCRYPT, 2, nonce, 12, nullptr, 0, len, expected, 16,
+                            expected + 2)
+                    == 0);
+                mbedtls_gcm_free(&gcm);
+                expectedLen = sizeof(expected);
+            }
+            REQUIRE(expectedLen == sizeof(expected));
+            REQUIRE(memcmp(out->data + crypto->cipher->key_len, expected, sizeof(expected)) == 0);
+            crypto->ctx_release(&e_ctx);
+        }
+    }
+}
+
+TEST_CASE("hkdf sha1", "[CryptoTest]")
+{
+    auto bytes = [](std::initializer_list<int> list) { return std::vector<unsigned char>(list.begin(), list.end()); };
+    SECTION("RFC 5869 test case 4")
+    {
+        std::vector<unsigned char> ikm(11, 0x0b);
+        auto salt = bytes({ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c });
+        auto info = bytes({ 0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9 });
+        auto expected = bytes({ 0x08, 0x5a, 0x01, 0xea, 0x1b, 0x10, 0xf3, 0x69, 0x33, 0x06, 0x8b, 0x56, 0xef, 0xa5,
+            0xad, 0x81, 0xa4, 0xf1, 0x4b, 0x82, 0x2f, 0x5b, 0x09, 0x15, 0x68, 0xa9, 0xcd, 0xd4, 0xf1, 0x55, 0xfd, 0xa2,
+            0xc2, 0x2e, 0x42, 0x24, 0x78, 0xd3, 0x05, 0xf3, 0xf8, 0x96 });
+        std::vector<unsigned char> okm(expected.size());
+        REQUIRE(crypto_hkdf_sha1(salt.data(), static_cast<int>(salt.size()), ikm.data(), static_cast<int>(ikm.size()),
+                    info.data(), static_cast<int>(info.size()), okm.data(), static_cast<int>(okm.size()))
+            == 0);
+        REQUIRE(okm == expected);
+    }
+    SECTION("RFC 5869 test case 7, no salt")
+    {
+        std::vector<unsigned char> ikm(22, 0x0c);
+        auto expected = bytes({ 0x2c, 0x91, 0x11, 0x72, 0x04, 0xd7, 0x45, 0xf3, 0x50, 0x0d, 0x63, 0x6a, 0x62, 0xf6,
+            0x4f, 0x0a, 0xb3, 0xba, 0xe5, 0x48, 0xaa, 0x53, 0xd4, 0x23, 0xb0, 0xd1, 0xf2, 0x7e, 0xbb, 0xa6, 0xf5, 0xe5,
+            0x67, 0x3a, 0x08, 0x1d, 0x70, 0xcc, 0xe7, 0xac, 0xfc, 0x48 });
+        std::vector<unsigned char> okm(expected.size());
+        REQUIRE(crypto_hkdf_sha1(nullptr, 0, ikm.data(), static_cast<int>(ikm.size()), nullptr, 0, okm.data(),
+                    static_cast<int>(okm.size()))
+            == 0);
+        REQUIRE(okm == expected);
+    }
+    SECTION("the mbed TLS md hkdf")
+    {
+        // key lengths of every aead method, and a salt longer than a SHA1 block.
+        const mbedtls_md_info_t* md = mbedtls_md_info_from_string("SHA1");
+        for (int saltLen : { 16, 24, 32, 100 }) {
+            auto salt = randomData(saltLen);
+            auto ikm = randomData(32);
+            const auto* s = reinterpret_cast<const unsigned char*>(salt.data());
+            const auto* k = reinterpret_cast<const unsigned char*>(ikm.data());
+            const auto* info = reinterpret_cast<const unsigned char*>(SUBKEY_INFO);
+            int infoLen = static_cast<int>(strlen(SUBKEY_INFO));
+            // three blocks of output, the last one partial.
+            unsigned char expected[42], okm[42];
+            REQUIRE(crypto_hkdf(md, s, saltLen, k, 32, info, infoLen, expected, sizeof(expected)) == 0);
+            REQUIRE(crypto_hkdf_sha1(s, saltLen, k, 32, info, infoLen, okm, sizeof(okm)) == 0);
+            REQUIRE(memcmp(okm, expected, sizeof(okm)) == 0);
+        }
+    }
+}
+
+TEST_CASE("aes-gcm is the mbed TLS aes-gcm", "[CryptoTest]")
+{
+    if (!aesgcm_is_available())
+        return;
+    // around the sixteen block runs of VAES and the eight block runs of AES-NI.
+    const size_t sizes[] { 0, 1, 16, 127, 128, 255, 256, 257, 1400, 0x3FFF };
+    for (size_t keyLen : { 16, 24, 32 }) {
+        auto key = randomData(keyLen);
+        auto nonce = randomData(AESGCM_NPUBBYTES);
+        auto ad = randomData(20);
+        const auto* k = reinterpret_cast<const unsigned char*>(key.data());
+        const auto* n = reinterpret_cast<const unsigned char*>(nonce.data());
+        const auto* a = reinterpret_cast<const unsigned char*>(ad.data());
+        mbedtls_gcm_context gcm;
+        mbedtls_gcm_init(&gcm);
+        REQUIRE(mbedtls_gcm_setkey(&gcm, MBEDTLS_CIPHER_ID_AES, k, static_cast<unsigned int>(keyLen * 8)) == 0);
+        aesgcm_ctx ctx;
+        REQUIRE(aesgcm_beforenm(&ctx, k, keyLen) == 0);
+        for (size_t size : sizes) {
+            auto plain = randomData(size);
+            const auto* m = reinterpret_cast<const unsigned char*>(plain.data());
+            std::vector<unsigned char> expected(size), sealed(size);
+            unsigned char expectedTag[16], tag[16];
+            REQUIRE(mbedtls_gcm_crypt_and_tag(&gcm, MBEDTLS_GCM_ENCRYPT, size, n, AESGCM_NPUBBYTES, a, ad.size(), m,
+                        expected.data(), sizeof(expectedTag), expectedTag)
+                == 0);
+            aesgcm_encrypt_detached(&ctx, sealed.data(), tag, m, size, a, ad.size(), n);
+            REQUIRE(sealed == expected);
+            REQUIRE(memcmp(tag, expectedTag, sizeof(tag)) == 0);
+
+            // opened in place, then a flipped tag bit must not open.
+            REQUIRE(aesgcm_decrypt_detached(&ctx, sealed.data(), sealed.data(), size, tag, a, ad.size(), n) == 0);
+            REQUIRE(memcmp(sealed.data(), m, size) == 0);
+            tag[0] ^= 1;
+            REQUIRE(aesgcm_decrypt_detached(&ctx, sealed.data(), expected.data(), size, tag, a, ad.size(), n) == -1);
+        }
+        // up to a block without additional data, the length block of a frame is two bytes.
+        for (size_t size = 0; size <= 16; ++size) {
+            auto plain = randomData(size);
+            const auto* m = reinterpret_cast<const unsigned char*>(plain.data());
+            unsigned char expected[16], sealed[16], expectedTag[16], tag[16];
+            REQUIRE(mbedtls_gcm_crypt_and_tag(&gcm, MBEDTLS_GCM_ENCRYPT, size, n, AESGCM_NPUBBYTES, nullptr, 0, m,
+                        expected, sizeof(expectedTag), expectedTag)
+                == 0);
+            aesgcm_encrypt_short(&ctx, sealed, tag, m, size, n);
+            REQUIRE(memcmp(sealed, expected, size) == 0);
+            REQUIRE(memcmp(tag, expectedTag, sizeof(tag)) == 0);
+            REQUIRE(aesgcm_decrypt_short(&ctx, sealed, sealed, size, tag, n) == 0);
+            REQUIRE(memcmp(sealed, m, size) == 0);
+            tag[15] ^= 0x80;
+            REQUIRE(aesgcm_decrypt_short(&ctx, sealed, expected, size, tag, n) == -1);
+        }
+        mbedtls_gcm_free(&gcm);
+    }
+}
+
+// not run by ctest: TESTCRYPTO "[!benchmark]"
+TEST_CASE("aes-gcm backend throughput", "[!benchmark]")
+{
+    if (!aesgcm_is_available())
+        return;
+    for (size_t keyLen : { 16, 24, 32 }) {
+        auto key = randomData(keyLen);
+        auto nonce = randomData(AESGCM_NPUBBYTES);
+        const auto* k = reinterpret_cast<const unsigned char*>(key.data());
+        const auto* n = reinterpret_cast<const unsigned char*>(nonce.data());
+        mbedtls_gcm_context gcm;
+        mbedtls_gcm_init(&gcm);
+        REQUIRE(mbedtls_gcm_setkey(&gcm, MBEDTLS_CIPHER_ID_AES, k, static_cast<unsigned int>(keyLen * 8)) == 0);
+        aesgcm_ctx ctx;
+        REQUIRE(aesgcm_beforenm(&ctx, k, keyLen) == 0);
+        for (size_t size : { 64, 1400, 0x3FFF }) {
+            auto plain = randomData(size);
+            const auto* m = reinterpret_cast<const unsigned char*>(plain.data());
+            std::vector<unsigned char> sealed(size);
+            unsigned char tag[16];
+            std::string name = "aes-" + std::to_string(keyLen * 8) + "-gcm " + std::to_string(size) + " bytes";
+            BENCHMARK(name + " mbed TLS")
+            {
+                return mbedtls_gcm_crypt_and_tag(&gcm, MBEDTLS_GCM_ENCRYPT, size, n, AESGCM_NPUBBYTES, nullptr, 0, m,
+                    sealed.data(), sizeof(tag), tag);
+            };
+            BENCHMARK(name + " aesgcm")
+            {
+                aesgcm_encrypt_detached(&ctx, sealed.data(), tag, m, size, nullptr, 0, n);
+                return tag[0];
+            };
+        }
+        mbedtls_gcm_free(&gcm);
+    }
+}
+
+// not run by ctest: TESTCRYPTO "[!benchmark]"
+TEST_CASE("aead frame throughput", "[!benchmark]")
+{
+    const char* aeadMethods[] { "aes-128-gcm", "aes-256-gcm", "chacha20-ietf-poly1305", "xchacha20-ietf-poly1305" };
+    for (auto method : aeadMethods) {
+        crypto_t* crypto = crypto_init("test-password", nullptr, method);
+        REQUIRE(crypto != nullptr);
+        for (size_t size : { 64, 1400, 0x3FFF }) {
+            // s_ctx only seals, e_ctx seals for d_ctx.
+            cipher_ctx_t s_ctx, e_ctx, d_ctx;
+            crypto->ctx_init(crypto->cipher, &s_ctx, 1);
+            crypto->ctx_init(crypto->cipher, &e_ctx, 1);
+            crypto->ctx_init(crypto->cipher, &d_ctx, 0);
+            auto plain = randomData(size);
+            auto in = inputBuf(plain, 0, size);
+            auto sealed = makeBuf();
+            auto opened = makeBuf();
+            // the salt goes out with the first frame, open it before the bloom filter knows it.
+            REQUIRE(crypto->encrypt(&in, sealed.get(), &e_ctx, 16) == CRYPTO_OK);
+            resetBloom();
+            REQUIRE(crypto->decrypt(sealed.get(), opened.get(), &d_ctx, 16) == CRYPTO_OK);
+
+            std::string name = std::string(method) + " " + std::to_string(size) + " bytes";
+            BENCHMARK(name + " seal")
+            {
+                return crypto->encrypt(&in, sealed.get(), &s_ctx, 16);
+            };
+            // the decryptor follows the encryptor, every frame is sealed before it is opened.
+            BENCHMARK(name + " seal+open")
+            {
+                crypto->encrypt(&in, sealed.get(), &e_ctx, 16);
+                return crypto->decrypt(sealed.get(), opened.get(), &d_ctx, 16);
+            };
+            REQUIRE(crypto->encrypt(&in, sealed.get(), &e_ctx, 16) == CRYPTO_OK);
+            REQUIRE(crypto->decrypt(sealed.get(), opened.get(), &d_ctx, 16) == CRYPTO_OK);
+            REQUIRE(memcmp(opened->data, plain.data(), size) == 0);
+            crypto->ctx_release(&s_ctx);
+            crypto->ctx_release(&e_ctx);
+            crypto->ctx_release(&d_ctx);
+        }
+    }
+}
+
+// not run by ctest: TESTCRYPTO "[!benchmark]"
+TEST_CASE("aead packet cost", "[!benchmark]")
+{
+    // every packet derives its own subkey. Opening is left out, the bloom filter turns away a salt it has seen.
+    const char* aeadMethods[] { "aes-128-gcm", "aes-256-gcm", "chacha20-ietf-poly1305" };
+    for (auto method : aeadMethods) {
+        crypto_t* crypto = crypto_init("test-password", nullptr, method);
+        REQUIRE(crypto != nullptr);
+        for (size_t size : { 100, 1400 }) {
+            auto plain = randomData(size);
+            auto in = inputBuf(plain, 0, size);
+            auto sealed = makeBuf();
+            BENCHMARK(std::string(method) + " " + std::to_string(size) + " bytes seal")
+            {
+                return crypto->encrypt_all(&in, sealed.get(), crypto->cipher, 16);
+            };
+        }
+    }
+}
@@ -0,0 +1,103 @@
+#include "DNSResolver.hpp"
+#include "uvw/loop.h"
+#include "uvw/timer.h"
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+#include <cstring>
+
+namespace
+{
+struct Result
+{
+    int calls = 0;
+    int af = 0;
+    sockaddr_storage addr {};
+};
+
+DNSResolver::Callback record(Result& result)
+{
+    return [&result](int af, const sockaddr_storage& addr, const sockaddr_storage&) {
+        ++result.calls;
+        result.af = af;
+        result.addr = addr;
+    };
+}
+
+uint16_t portOf(const sockaddr_storage& addr)
+{
+    if (addr.ss_family == AF_INET6)
+        return ntohs(reinterpret_cast<const sockaddr_in6&>(addr).sin6_port);
+    return ntohs(reinterpret_cast<const sockaddr_in&>(addr).sin_port);
+}
+} // namespace
+
+TEST_CASE("ip literal", "[DNSResolverTest]")
+{
+    auto loop = uvw::Loop::create();
+    DNSResolver resolver(loop);
+    Result v4, v6;
+    resolver.resolve("127.0.0.1", 443, false, record(v4));
+    resolver.resolve("::1", 443, false, record(v6));
+    // answered right away, nothing is cached.
+    REQUIRE(v4.calls == 1);
+    REQUIRE(v4.af == AF_INET);
+    REQUIRE(portOf(v4.addr) == 443);
+    REQUIRE(v6.calls == 1);
+    REQUIRE(v6.af == AF_INET6);
+    REQUIRE(resolver.cacheSize() == 0);
+}
+
+TEST_CASE("cache", "[DNSResolverTest]")
+{
+    auto loop = uvw::Loop::create();
+    DNSResolver resolver(loop);
+    Result first, waiting, cached;
+    resolver.resolve("localhost", 8388, false, record(first));
+    resolver.resolve("localhost", 8388, false, record(waiting));
+    REQUIRE(first.calls == 0);
+    loop->run();
+    REQUIRE(first.calls == 1);
+    REQUIRE(first.af != -1);
+    REQUIRE(portOf(first.addr) == 8388);
+    // the second lookup waited for the first request.
+    REQUIRE(waiting.calls == 1);
+    REQUIRE(memcmp(&waiting.addr, &first.addr, sizeof(sockaddr_storage)) == 0);
+    REQUIRE(resolver.cacheSize() == 1);
+    resolver.resolve("localhost", 8388, false, record(cached));
+    REQUIRE(cached.calls == 1);
+    REQUIRE(memcmp(&cached.addr, &first.addr, sizeof(sockaddr_storage)) == 0);
+}
+
+TEST_CASE("ttl", "[DNSResolverTest]")
+{
+    auto loop = uvw::Loop::create();
+    DNSResolver resolver(loop, 1);
+    Result first, stale;
+    resolver.resolve("localhost", 80, false, record(first));
+    loop->run();
+    REQUIRE(first.calls == 1);
+    auto timer = loop->resource<uvw::TimerHandle>();
+    timer->on<uvw::TimerEvent>([&](auto&, auto& h) {
+        h.close();
+        resolver.resolve("localhost", 80, false, record(stale));
+        // expired, so it is looked up again.
+        REQUIRE(stale.calls == 0);
+    });
+    timer->start(uvw::TimerHandle::Time { 5 }, uvw::TimerHandle::Time { 0 });
+    loop->run();
+    REQUIRE(stale.calls == 1);
+    REQUIRE(stale.af == first.af);
+}
+
+TEST_CASE("cancel", "[DNSResolverTest]")
+{
+    auto loop = uvw::Loop::create();
+    Result result;
+    {
+        DNSResolver resolver(loop);
+        resolver.resolve("localhost", 80, false, record(result));
+        resolver.cancel();
+    }
+    loop->run();
+    REQUIRE(result.calls == 0);
+}
@@ -0,0 +1,183 @@
+extern "C"
+{
+#include "crypto.h"
+}
+#include "RemotePool.hpp"
+#include "shadowsocks.h"
+#include "uvw/tcp.h"
+#include "uvw/timer.h"
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+namespace
+{
+constexpr int serverPort = 18931;
+constexpr int localPort = 18932;
+constexpr size_t saltLen = 32;
+constexpr size_t tagLen = 16;
+
+// one side of a chacha20-ietf-poly1305 stream, the nonce counts up little endian per seal or open.
+struct StreamKey
+{
+    unsigned char subkey[32];
+    unsigned char nonce[12] {};
+
+    StreamKey(const unsigned char* salt)
+    {
+        unsigned char key[32];
+        crypto_derive_key("test", key, sizeof(key));
+        crypto_hkdf_sha1(salt, saltLen, key, sizeof(key), reinterpret_cast<const unsigned char*>(SUBKEY_INFO),
+            static_cast<int>(strlen(SUBKEY_INFO)), subkey, sizeof(subkey));
+    }
+
+    void step() { sodium_increment(nonce, sizeof(nonce)); }
+
+    void seal(std::vector<char>& out, const char* m, size_t mlen)
+    {
+        auto at = out.size();
+        out.resize(at + mlen + tagLen);
+        crypto_aead_chacha20poly1305_ietf_encrypt(reinterpret_cast<unsigned char*>(&out[at]), nullptr,
+            reinterpret_cast<const unsigned char*>(m), mlen, nullptr, 0, nullptr, nonce, subkey);
+        step();
+    }
+
+    bool open(char* m, const char* c, size_t clen)
+    {
+        auto r = crypto_aead_chacha20poly1305_ietf_decrypt(reinterpret_cast<unsigned char*>(m), nullptr, nullptr,
+            reinterpret_cast<const unsigned char*>(c), clen, nullptr, 0, nonce, subkey);
+        step();
+        return r == 0;
+    }
+};
+} // namespace
+
+// the server salt reaches ss-local while the target address waits for the client's first data, it must
+// still be the first chunk to the server and the reply must still reach the client.
+TEST_CASE("server salt during the coalesce window", "[tcp]")
+{
+    std::thread local([] {
+        profile_t profile {};
+        profile.remote_host = "127.0.0.1";
+        profile.local_addr = "127.0.0.1";
+        profile.method = "chacha20-ietf-poly1305";
+        profile.password = "test";
+        profile.remote_port = serverPort;
+        profile.local_port = localPort;
+        profile.timeout = 60000;
+        profile.coalesce_window = 300;
+        start_ssr_uv_local_server(profile);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    const char target[] { 1, 127, 0, 0, 1, 0x1f, char(0x90) };
+    const std::string reply = "world";
+    auto loop = uvw::Loop::create();
+    auto server = loop->resource<uvw::TCPHandle>();
+    auto client = loop->resource<uvw::TCPHandle>();
+    std::vector<char> upstream;
+    std::string firstChunk;
+    std::string downstream;
+    std::shared_ptr<uvw::TCPHandle> peer;
+    auto guard = loop->resource<uvw::TimerHandle>();
+    // ss-local keeps a connection the client half closed, the test also ends it from the server side.
+    auto closeAll = [&] {
+        for (uvw::BaseHandle* h : { static_cast<uvw::BaseHandle*>(server.get()), static_cast<uvw::BaseHandle*>(client.get()),
+                 static_cast<uvw::BaseHandle*>(peer.get()), static_cast<uvw::BaseHandle*>(guard.get()) })
+            if (h && !h->closing())
+                h->close();
+    };
+
+    server->on<uvw::ListenEvent>([&](const uvw::ListenEvent&, uvw::TCPHandle& handle) {
+        auto socket = handle.loop().resource<uvw::TCPHandle>();
+        handle.accept(*socket);
+        handle.close();
+        peer = socket;
+        // the salt leaves at once, ss-local is still waiting out the window.
+        auto salt = std::make_unique<char[]>(saltLen);
+        randombytes_buf(salt.get(), saltLen);
+        auto sealer = std::make_shared<StreamKey>(reinterpret_cast<unsigned char*>(salt.get()));
+        socket->write(std::move(salt), saltLen);
+        socket->on<uvw::DataEvent>([&, sealer](uvw::DataEvent& event, uvw::TCPHandle& sock) {
+            upstream.insert(upstream.end(), event.data.get(), event.data.get() + event.length);
+            if (!firstChunk.empty() || upstream.size() < saltLen + 2 + tagLen)
+                return;
+            StreamKey opener(reinterpret_cast<unsigned char*>(upstream.data()));
+            unsigned char lenBlock[2];
+            if (!opener.open(reinterpret_cast<char*>(lenBlock), upstream.data() + saltLen, 2 + tagLen))
+                return closeAll();
+            size_t len = lenBlock[0] << 8 | lenBlock[1];
+            if (upstream.size() < saltLen + 2 + tagLen + len + tagLen)
+                return;
+            firstChunk.resize(len);
+            if (!opener.open(&firstChunk[0], upstream.data() + saltLen + 2 + tagLen, len + tagLen))
+                return closeAll();
+            std::vector<char> frame;
+            char replyLen[2] { 0, static_cast<char>(reply.size()) };
+            sealer->seal(frame, replyLen, 2);
+            sealer->seal(frame, reply.data(), reply.size());
+            auto data = std::make_unique<char[]>(frame.size());
+            memcpy(data.get(), frame.data(), frame.size());
+            sock.write(std::move(data), frame.size());
+        });
+        socket->on<uvw::EndEvent>([](const uvw::EndEvent&, uvw::TCPHandle& sock) { sock.close(); });
+        socket->on<uvw::ErrorEvent>([](const uvw::ErrorEvent&, uvw::TCPHandle& sock) { sock.close(); });
+        socket->read();
+    });
+
+    // ss-local answers the greeting with 2 bytes and the connect request with 10.
+    client->once<uvw::ConnectEvent>([&](const uvw::ConnectEvent&, uvw::TCPHandle& handle) {
+        handle.write(std::unique_ptr<char[]>(new char[3] { 5, 1, 0 }), 3);
+        handle.read();
+    });
+    client->on<uvw::DataEvent>([&](uvw::DataEvent& event, uvw::TCPHandle& handle) {
+        auto greeted = downstream.size() < 2;
+        downstream.append(event.data.get(), event.length);
+        if (greeted && downstream.size() == 2) {
+            auto request = std::unique_ptr<char[]>(new char[3 + sizeof(target)] { 5, 1, 0 });
+            memcpy(request.get() + 3, target, sizeof(target));
+            handle.write(std::move(request), 3 + sizeof(target));
+        } else if (downstream.size() >= 2 + 10 + reply.size()) {
+            closeAll();
+        }
+    });
+    client->on<uvw::ErrorEvent>([&](const uvw::ErrorEvent&, uvw::TCPHandle&) { closeAll(); });
+    client->on<uvw::EndEvent>([&](const uvw::EndEvent&, uvw::TCPHandle&) { closeAll(); });
+
+    guard->once<uvw::TimerEvent>([&](auto&, auto&) { closeAll(); });
+    guard->start(uvw::TimerHandle::Time { 5000 }, uvw::TimerHandle::Time { 0 });
+
+    server->bind("127.0.0.1", serverPort);
+    server->listen();
+    client->connect("127.0.0.1", localPort);
+    loop->run();
+    stop_ssr_uv_local_server();
+    local.join();
+
+    REQUIRE(firstChunk == std::string(target, sizeof(target)));
+    REQUIRE(downstream.size() == 2 + 10 + reply.size());
+    REQUIRE(downstream.substr(12) == reply);
+}
+
+// a connect the kernel refuses at once fails inside connect(), fill() must still return.
+TEST_CASE("remote pool connect failing synchronously", "[tcp]")
+{
+    auto loop = uvw::Loop::create();
+    sockaddr_storage addr {};
+    auto& in = reinterpret_cast<sockaddr_in&>(addr);
+    in.sin_family = AF_INET;
+    in.sin_port = htons(80);
+    in.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+    {
+        RemotePool pool(loop, 4, 1000);
+        pool.fill(addr);
+        REQUIRE(pool.idleCount() == 0);
+        loop->run<uvw::Loop::Mode::NOWAIT>();
+    }
+    loop->run();
+}
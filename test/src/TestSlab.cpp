@@ -0,0 +1,72 @@
+#include "Slab.hpp"
+#include <string>
+#include <vector>
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+namespace
+{
+struct Counted
+{
+    Counted(int value, int& alive)
+        : value(value)
+        , alive(alive)
+    {
+        ++alive;
+    }
+    ~Counted() { --alive; }
+    int value;
+    int& alive;
+};
+} // namespace
+
+TEST_CASE("emplace and erase", "[SlabTest]")
+{
+    int alive = 0;
+    Slab<Counted> slab;
+    auto a = slab.emplace(1, alive);
+    auto b = slab.emplace(2, alive);
+    REQUIRE(slab.size() == 2);
+    REQUIRE(alive == 2);
+    REQUIRE(slab.find(a)->value == 1);
+    REQUIRE(slab.find(b)->value == 2);
+    slab.erase(a);
+    REQUIRE(alive == 1);
+    REQUIRE(slab.find(a) == nullptr);
+    // a second erase is ignored.
+    slab.erase(a);
+    REQUIRE(slab.size() == 1);
+    REQUIRE(alive == 1);
+}
+
+TEST_CASE("slots are reused", "[SlabTest]")
+{
+    int alive = 0;
+    Slab<Counted> slab;
+    auto a = slab.emplace(1, alive);
+    Counted* first = slab.find(a);
+    slab.erase(a);
+    auto c = slab.emplace(3, alive);
+    // same slot, a new generation: the old id does not find the new object.
+    REQUIRE(slab.find(c) == first);
+    REQUIRE(slab.find(a) == nullptr);
+    REQUIRE(slab.capacity() == 1);
+}
+
+TEST_CASE("objects do not move", "[SlabTest]")
+{
+    int alive = 0;
+    std::vector<std::pair<Slab<Counted>::Id, Counted*>> objects;
+    {
+        Slab<Counted> slab;
+        for (int i = 0; i < 1000; ++i) {
+            auto id = slab.emplace(i, alive);
+            objects.emplace_back(id, slab.find(id));
+        }
+        for (auto& [id, object] : objects)
+            REQUIRE(slab.find(id) == object);
+        REQUIRE(alive == 1000);
+    }
+    // the slab destroys what is left.
+    REQUIRE(alive == 0);
+}
@@ -0,0 +1,102 @@
+#include <TimerWheel.hpp>
+#include <memory>
+#include <vector>
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+namespace
+{
+struct Session : TimerWheel::Entry
+{
+    int id = 0;
+};
+} // namespace
+
+TEST_CASE("expire", "[TimerWheelTest]")
+{
+    std::vector<int> expired;
+    TimerWheel wheel(10, [&](TimerWheel::Entry& e) { expired.push_back(static_cast<Session&>(e).id); });
+    Session a, b;
+    a.id = 1;
+    b.id = 2;
+    wheel.schedule(a, 100, 0);
+    wheel.schedule(b, 50, 0);
+    REQUIRE(wheel.size() == 2);
+    wheel.advance(40);
+    REQUIRE(expired.empty());
+    wheel.advance(50);
+    REQUIRE(expired == std::vector<int> { 2 });
+    wheel.advance(99);
+    REQUIRE(expired.size() == 1);
+    wheel.advance(100);
+    REQUIRE(expired == std::vector<int> { 2, 1 });
+    REQUIRE(wheel.size() == 0);
+    REQUIRE(wheel.expiredCount() == 2);
+    REQUIRE_FALSE(a.scheduled());
+}
+
+TEST_CASE("touch", "[TimerWheelTest]")
+{
+    int expired = 0;
+    TimerWheel wheel(10, [&](TimerWheel::Entry&) { ++expired; });
+    Session s;
+    wheel.schedule(s, 100, 0);
+    // touched before its deadline every time, it never expires.
+    for (uint64_t now = 50; now <= 2000; now += 50) {
+        wheel.advance(now);
+        wheel.schedule(s, 100, now);
+    }
+    REQUIRE(expired == 0);
+    wheel.advance(2099);
+    REQUIRE(expired == 0);
+    wheel.advance(2100);
+    REQUIRE(expired == 1);
+    // an earlier deadline is honoured too.
+    wheel.schedule(s, 100000, 2100);
+    wheel.schedule(s, 10, 2100);
+    wheel.advance(2110);
+    REQUIRE(expired == 2);
+}
+
+TEST_CASE("levels", "[TimerWheelTest]")
+{
+    std::vector<uint64_t> expiredAt;
+    uint64_t now = 0;
+    TimerWheel wheel(1, [&](TimerWheel::Entry&) { expiredAt.push_back(now); });
+    // one timeout per level, and one past the last level.
+    const uint64_t timeouts[] { 5, 300, 70000, 5000000, 20000000 };
+    std::vector<std::unique_ptr<Session>> sessions;
+    for (auto timeout : timeouts) {
+        sessions.push_back(std::make_unique<Session>());
+        wheel.schedule(*sessions.back(), timeout, 0);
+    }
+    // step in uneven strides so cascades happen inside one advance.
+    while (wheel.size() > 0 && now < 30000000) {
+        now += 997;
+        wheel.advance(now);
+    }
+    REQUIRE(expiredAt.size() == std::size(timeouts));
+    for (size_t i = 0; i < std::size(timeouts); ++i) {
+        REQUIRE(expiredAt[i] >= timeouts[i]);
+        REQUIRE(expiredAt[i] < timeouts[i] + 997);
+    }
+}
+
+TEST_CASE("destroy in callback", "[TimerWheelTest]")
+{
+    std::vector<std::unique_ptr<Session>> sessions(8);
+    TimerWheel wheel(10, [&](TimerWheel::Entry& e) {
+        // the first one to expire takes every other session down with it.
+        for (auto& s : sessions) {
+            if (s.get() != &e)
+                s.reset();
+        }
+    });
+    for (auto& s : sessions) {
+        s = std::make_unique<Session>();
+        wheel.schedule(*s, 30, 0);
+    }
+    wheel.advance(30);
+    REQUIRE(wheel.size() == 0);
+    REQUIRE(wheel.expiredCount() == 1);
+}